@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-riscv.h"
+#include "profile.h"
+#include "reverse.h"
+#include "journal.h"
+#include "memchar.h"
+#include "fuzz.h"
+
+int FUZZ_ON;
+
+typedef struct {
+	uint32_t regs[MIPS_REGS];
+	uint32_t pc, instructions;
+	uint32_t words;		/* words executed, all-zero bubbles included */
+	Mem_Word *mem;		/* words written, sorted by address, with their final value */
+	uint32_t mem_count, mem_size;
+	int self_modifying;	/* stored into its own text, the pipeline fetches stale words */
+} Fuzz_Result;
+
+static uint64_t cover[1 << (FUZZ_COVER_BITS - 6)];	/* one bit per edge */
+static uint32_t cover_prev, cover_new, cover_edges;
+
+static uint32_t corpus[FUZZ_CORPUS_SIZE][FUZZ_MAX_LENGTH];
+static uint32_t corpus_count;
+
+static uint32_t rng;
+
+/* registers the prologue points at the data segment, loads and stores use them as base */
+static const uint32_t POINTERS[] = { 8, 9, 18, 19 };
+#define PROLOGUE_LENGTH 4
+
+static uint32_t rnd()
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static uint32_t rnd_below(uint32_t n) { return rnd() % n; }
+
+/***************************************************************/
+/* Record the pipeline-state edge of the cycle that just ended */
+/* in the coverage map. The state is the instruction decoded   */
+/* into ID/EX, the classes in EX/MEM and MEM/WB, the stall     */
+/* cause, the flush and which units are busy.                  */
+/***************************************************************/
+void fuzz_cover()
+{
+	fuzz_cover_state((ID_EX.IR ? ID_EX.desc->id : 0) |
+		((EX_MEM.IR ? EX_MEM.desc->iclass : 0) << 6) |
+		((MEM_WB.IR ? MEM_WB.desc->iclass : 0) << 10) |
+		(STALL_CAUSE << 14) | (BRANCH_FLUSH << 17) |
+		((MULTIPLIER.count != 0) << 18) | ((DIVIDER.count != 0) << 19));
+}
+
+/* record the edge from the previous cycle's state to <state>, which fits in 20 bits */
+void fuzz_cover_state(uint32_t state)
+{
+	uint32_t edge = ((((uint64_t)cover_prev << 20) | state) * 0x9e3779b97f4a7c15ull) >> (64 - FUZZ_COVER_BITS);
+
+	cover_prev = state;
+	if (!(cover[edge >> 6] & (1ull << (edge & 63)))) {
+		cover[edge >> 6] |= 1ull << (edge & 63);
+		cover_new++;
+		cover_edges++;
+	}
+}
+
+//***************** TEST CASE GENERATION *********************
+static uint32_t encode_i(uint32_t inst, int32_t imm) { return (inst & 0x000fffff) | ((uint32_t)imm << 20); }
+
+static uint32_t encode_s(uint32_t inst, int32_t imm)
+{
+	return (inst & 0x01fff07f) | (((uint32_t)imm & 0xfe0) << 20) | (((uint32_t)imm & 0x1f) << 7);
+}
+
+static uint32_t encode_b(uint32_t inst, int32_t imm)
+{
+	return (inst & 0x01fff07f) |
+		(((uint32_t)imm & 0x1000) << 19) |	/* imm[12]   */
+		(((uint32_t)imm & 0x7e0) << 20) |	/* imm[10:5] */
+		(((uint32_t)imm & 0x1e) << 7) |		/* imm[4:1]  */
+		(((uint32_t)imm & 0x800) >> 4);		/* imm[11]   */
+}
+
+static uint32_t encode_j(uint32_t inst, int32_t imm)
+{
+	return (inst & 0xfff) |
+		(((uint32_t)imm & 0x100000) << 11) |	/* imm[20]    */
+		(((uint32_t)imm & 0x7fe) << 20) |	/* imm[10:1]  */
+		(((uint32_t)imm & 0x800) << 9) |	/* imm[11]    */
+		((uint32_t)imm & 0xff000);		/* imm[19:12] */
+}
+
+static uint32_t set_rs1(uint32_t inst, uint32_t reg) { return (inst & ~0x000f8000u) | (reg << 15); }
+
+/* a random valid instruction for word <pos> of a <length>-word program, or now and then an all-zero word */
+static uint32_t random_inst(uint32_t pos, uint32_t length)
+{
+	const inst_desc_t *d = &ISA_TABLE[1 + rnd_below(NUM_INSTS - 1)];
+	uint32_t inst = (rnd() & ~d->mask) | d->match;
+	uint32_t back = pos - PROLOGUE_LENGTH + 1;	/* words back to the start of the body */
+	int32_t offset;
+
+	/* the cores skip these without retiring them, which the instruction count checks */
+	if (rnd_below(32) == 0) return 0;
+	switch (d->iclass) {
+		case CLASS_LOAD:
+			inst = set_rs1(inst, POINTERS[rnd_below(4)]);
+			return encode_i(inst, rnd_below(256) & -(int32_t)d->mem_bytes);
+		case CLASS_STORE:
+			inst = set_rs1(inst, POINTERS[rnd_below(4)]);
+			return encode_s(inst, rnd_below(256) & -(int32_t)d->mem_bytes);
+		case CLASS_BRANCH:
+			/* mostly forward, or the loops rarely terminate */
+			offset = rnd_below(8) ? 4 * (1 + rnd_below(8)) : -4 * (int32_t)rnd_below(back);
+			return encode_b(inst, offset);
+		case CLASS_JAL:
+			return encode_j(inst, 4 * (1 + rnd_below(length - pos)));
+		default:
+			return inst;
+	}
+}
+
+static void random_program(uint32_t *prog, uint32_t length)
+{
+	uint32_t i;
+	for (i = 0; i < PROLOGUE_LENGTH; i++)
+		prog[i] = (MEM_DATA_BEGIN & 0xfffff000) | (POINTERS[i] << 7) | 0x37;	/* lui ptr, %hi(data) */
+	for (; i < length; i++)
+		prog[i] = random_inst(i, length);
+}
+
+static void mutate(uint32_t *prog, uint32_t length)
+{
+	uint32_t n = 1 + rnd_below(4), body = length - PROLOGUE_LENGTH;
+	while (n--) {
+		uint32_t i = PROLOGUE_LENGTH + rnd_below(body), j = PROLOGUE_LENGTH + rnd_below(body), t;
+		switch (rnd_below(4)) {
+			case 0:
+				prog[i] = random_inst(i, length);
+				break;
+			case 1: /* a bit of rd, funct3, rs1 or rs2 */
+				prog[i] ^= 1u << (7 + rnd_below(18));
+				break;
+			case 2:
+				t = prog[i]; prog[i] = prog[j]; prog[j] = t;
+				break;
+			default:
+				prog[i] = prog[j];
+				break;
+		}
+	}
+}
+
+//***************** RUNNING A TEST CASE **********************
+/* load <prog> into the text and start from all-zero registers */
+static void start_case(const uint32_t *prog, uint32_t length)
+{
+	uint32_t i;
+	JOURNAL_ON = FALSE;	// the text is rewritten by every test case
+	for (i = 0; i < length; i++) mem_write_32(MEM_TEXT_BEGIN + 4 * i, prog[i]);
+	memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+	reset_pipeline();
+	JOURNAL_ON = TRUE;
+}
+
+/* record the final state and roll memory back to the starting image */
+static void finish_case(Fuzz_Result *res)
+{
+	uint32_t i;
+
+	memcpy(res->regs, CURRENT_STATE.REGS, sizeof(res->regs));
+	res->pc = CURRENT_STATE.PC;
+	res->instructions = INSTRUCTION_COUNT;
+	res->self_modifying = 0;
+
+	if (journal_length() > res->mem_size) {
+		res->mem_size = journal_length();
+		res->mem = realloc(res->mem, res->mem_size * sizeof(Mem_Word));
+	}
+	res->mem_count = journal_written(0, res->mem);
+	for (i = 0; i < res->mem_count; i++) {
+		if (in_program(res->mem[i].address & ~3u) || in_program((res->mem[i].address + 3) & ~3u))
+			res->self_modifying = 1;
+	}
+	journal_rollback();
+}
+
+/* returns FALSE if the program did not leave its text within the budget */
+static int run_reference(const uint32_t *prog, uint32_t length, Fuzz_Result *res)
+{
+	uint32_t budget = length * FUZZ_INSTS_PER_WORD;
+	start_case(prog, length);
+	res->words = 0;
+	while (RUN_FLAG && INSTRUCTION_COUNT < budget) {
+		step_functional();
+		res->words++;
+	}
+	finish_case(res);
+	return !RUN_FLAG;
+}
+
+/* <words> as executed by the reference, a bubble costs the pipeline a fetch cycle like an instruction */
+static int run_pipeline(const uint32_t *prog, uint32_t length, uint32_t words, Fuzz_Result *res)
+{
+	uint32_t budget = words * (DIVIDER.latency + MULTIPLIER.latency + 8) + 64;
+	start_case(prog, length);
+	cover_prev = 0;
+	while (RUN_FLAG && CYCLE_COUNT < budget) cycle();
+	finish_case(res);
+	return !RUN_FLAG;
+}
+
+static const char* diff_results(const Fuzz_Result *ref, const Fuzz_Result *pipe)
+{
+	if (memcmp(ref->regs, pipe->regs, sizeof(ref->regs))) return "registers";
+	if (ref->pc != pipe->pc) return "PC";
+	if (ref->instructions != pipe->instructions) return "instruction count";
+	if (ref->mem_count != pipe->mem_count ||
+		memcmp(ref->mem, pipe->mem, ref->mem_count * sizeof(Mem_Word))) return "memory";
+	return NULL;
+}
+
+static void write_case(const uint32_t *prog, uint32_t length, const char *prefix, uint32_t n)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+	uint32_t i;
+
+	if (snprintf(path, sizeof(path), "%s.fuzz%u.in", prefix, n) >= (int)sizeof(path)) {
+		printf("\tError: test case file name for %s is too long\n", prefix);
+		return;
+	}
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("\tError: Can't write %s\n", path);
+		return;
+	}
+	for (i = 0; i < length; i++) fprintf(fp, "%08x\n", prog[i]);
+	fclose(fp);
+	printf("\ttest case written to %s\n", path);
+}
+
+/***************************************************************/
+/* Run <cases> test cases of <length> instructions through the */
+/* pipeline and the functional model and compare the results.  */
+/* Test cases that reach new coverage edges are kept and       */
+/* mutated into later ones. With a <prefix>, the first failing */
+/* test cases are written to <prefix>.fuzz<n>.in.              */
+/***************************************************************/
+void fuzz_run(uint32_t cases, uint32_t length, uint32_t seed, const char *prefix)
+{
+	Fuzz_Result ref, pipe;
+	uint32_t prog[FUZZ_MAX_LENGTH];
+	uint32_t c, mismatches = 0, timeouts = 0, hangs = 0, self_modifying = 0;
+	int reverse_on = REVERSE_ON, memchar_on = MEMCHAR_ON;
+	struct timespec t0, t1;
+	double seconds;
+	const char *what;
+
+	if (length <= PROLOGUE_LENGTH || length > FUZZ_MAX_LENGTH) {
+		printf("Test cases must have %u to %u instructions\n\n", PROLOGUE_LENGTH + 1, FUZZ_MAX_LENGTH);
+		return;
+	}
+
+	reset();
+	/* the loaded program is replaced by the test cases */
+	for (c = 0; c < PROGRAM_SIZE; c++) mem_write_32(MEM_TEXT_BEGIN + 4 * c, 0);
+	PROGRAM_SIZE = length;
+	profile_init();
+
+	ref.mem = pipe.mem = NULL;
+	ref.mem_size = pipe.mem_size = 0;
+	corpus_count = 0;
+	memset(cover, 0, sizeof(cover));
+	cover_edges = 0;
+	rng = seed ? seed : 1;
+
+	REVERSE_ON = FALSE;
+	MEMCHAR_ON = FALSE;
+	FUZZ_ON = TRUE;
+	printf("Fuzzing %u test cases of %u instructions...\n\n", cases, length);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	for (c = 0; c < cases; c++) {
+		if (corpus_count == 0 || rnd_below(8) == 0) {
+			random_program(prog, length);
+		}
+		else {
+			memcpy(prog, corpus[rnd_below(corpus_count)], length * sizeof(uint32_t));
+			mutate(prog, length);
+		}
+
+		if (!run_reference(prog, length, &ref)) {
+			timeouts++;
+			continue;
+		}
+		cover_new = 0;
+		if (!run_pipeline(prog, length, ref.words, &pipe)) {
+			what = "pipeline did not finish";
+			hangs++;
+		}
+		else if (ref.self_modifying || pipe.self_modifying) {
+			self_modifying++;
+			continue;
+		}
+		else {
+			what = diff_results(&ref, &pipe);
+		}
+
+		if (what) {
+			printf("Mismatch in test case %u: %s\n", c, what);
+			if (prefix && mismatches < 16) write_case(prog, length, prefix, mismatches);
+			mismatches++;
+		}
+		else if (cover_new) {
+			uint32_t slot = corpus_count < FUZZ_CORPUS_SIZE ? corpus_count++ : rnd_below(FUZZ_CORPUS_SIZE);
+			memcpy(corpus[slot], prog, length * sizeof(uint32_t));
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	FUZZ_ON = FALSE;
+	REVERSE_ON = reverse_on;
+	MEMCHAR_ON = memchar_on;
+
+	printf("-------------------------------------\n");
+	printf("Fuzzing Results\n");
+	printf("-------------------------------------\n");
+	printf("Test cases\t\t: %u in %.2f s (%.0f per second)\n", cases, seconds, seconds > 0 ? cases / seconds : 0.0);
+	printf("Coverage edges\t\t: %u (%.2f%% of the map)\n", cover_edges, 100.0 * cover_edges / (1 << FUZZ_COVER_BITS));
+	printf("Corpus\t\t\t: %u\n", corpus_count);
+	printf("Reference timeouts\t: %u\n", timeouts);
+	printf("Self-modifying\t\t: %u\n", self_modifying);
+	printf("Pipeline hangs\t\t: %u\n", hangs);
+	printf("Mismatches\t\t: %u\n", mismatches);
+	printf("-------------------------------------\n\n");
+
+	JOURNAL_ON = FALSE;
+	free(ref.mem);
+	free(pipe.mem);
+	reset();
+}
@@ -0,0 +1,23 @@
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Coverage-guided fuzzing of the pipeline against the         */
+/* functional model (step_functional()).                       */
+/* Memory is brought back to the starting image by rolling     */
+/* back the journal of each test case, instead of reset().     */
+/***************************************************************/
+#define FUZZ_COVER_BITS 22		/* coverage map of 2^22 edges */
+#define FUZZ_CORPUS_SIZE 1024		/* test cases kept for mutation */
+#define FUZZ_MAX_LENGTH 256		/* instructions per test case, prologue included */
+#define FUZZ_INSTS_PER_WORD 32		/* reference run budget: this many instructions per program word */
+
+extern int FUZZ_ON;
+
+void fuzz_run(uint32_t cases, uint32_t length, uint32_t seed, const char *prefix);
+void fuzz_cover();
+void fuzz_cover_state(uint32_t state);
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-riscv.h"
+#include "journal.h"
+
+int JOURNAL_ON;
+
+static Mem_Word *entries;
+static uint32_t count, size;
+
+/* called by mem_write_32() before it writes <address> */
+void journal_record(uint32_t address)
+{
+	if (count == size) {
+		size = size ? 2 * size : 4096;
+		entries = realloc(entries, size * sizeof(Mem_Word));
+	}
+	entries[count].address = address;
+	entries[count].value = mem_read_32(address);
+	count++;
+}
+
+/***************************************************************/
+/* Undo the recorded writes, newest first, and empty the journal */
+/***************************************************************/
+void journal_rollback()
+{
+	int on = JOURNAL_ON;
+	JOURNAL_ON = FALSE;
+	while (count) {
+		count--;
+		mem_write_32(entries[count].address, entries[count].value);
+	}
+	JOURNAL_ON = on;
+}
+
+uint32_t journal_length()
+{
+	return count;
+}
+
+static int compare_words(const void *a, const void *b)
+{
+	uint32_t x = ((const Mem_Word*)a)->address, y = ((const Mem_Word*)b)->address;
+	return (x > y) - (x < y);
+}
+
+/***************************************************************/
+/* The words written since entry <from>, sorted by address     */
+/* with their current value. <out> needs room for              */
+/* journal_length() - from words, the count is returned.       */
+/***************************************************************/
+uint32_t journal_written(uint32_t from, Mem_Word *out)
+{
+	uint32_t i, n = 0;
+
+	memcpy(out, entries + from, (count - from) * sizeof(Mem_Word));
+	qsort(out, count - from, sizeof(Mem_Word), compare_words);
+	for (i = 0; i < count - from; i++) {
+		if (n && out[n - 1].address == out[i].address) continue;
+		out[n].address = out[i].address;
+		out[n].value = mem_read_32(out[i].address);
+		n++;
+	}
+	return n;
+}
@@ -0,0 +1,24 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Memory journal: while JOURNAL_ON, mem_write_32() records    */
+/* every word it overwrites together with the old value.       */
+/* Rolling the journal back restores memory without reset(),   */
+/* which drops every region and reloads the program.           */
+/***************************************************************/
+typedef struct {
+	uint32_t address;
+	uint32_t value;
+} Mem_Word;
+
+extern int JOURNAL_ON;
+
+void journal_record(uint32_t address);
+void journal_rollback();
+uint32_t journal_length();
+uint32_t journal_written(uint32_t from, Mem_Word *out);
+
+#endif
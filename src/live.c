@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mu-riscv.h"
+#include "ooo.h"
+#include "live.h"
+
+int LIVE_ON;
+uint32_t LIVE_NEXT;
+
+static Live_Stats *live;
+static char live_name[256];
+
+/* (cycles, instructions) at the last LIVE_WINDOW updates */
+static uint32_t window_cycles[LIVE_WINDOW], window_insts[LIVE_WINDOW];
+static uint32_t window_head, window_count;
+
+/***************************************************************/
+/* Create the shared-memory object <name> and publish into it  */
+/* every <interval> cycles                                     */
+/***************************************************************/
+int live_start(const char *name, uint32_t interval)
+{
+	int fd, i;
+	size_t len, skip;
+
+	if (LIVE_ON) live_stop();
+	if (interval == 0) interval = 1;
+
+	snprintf(live_name, sizeof(live_name), "%s%s", name[0] == '/' ? "" : "/", name);
+	fd = shm_open(live_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, sizeof(Live_Stats)) < 0) {
+		printf("Error: Can't create shared memory %s\n\n", live_name);
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	live = mmap(NULL, sizeof(Live_Stats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (live == MAP_FAILED) {
+		printf("Error: Can't map shared memory %s\n\n", live_name);
+		shm_unlink(live_name);
+		return -1;
+	}
+
+	live->magic = LIVE_MAGIC;
+	live->pid = getpid();
+	live->interval = interval;
+	len = strlen(prog_file);
+	skip = len < sizeof(live->program) ? 0 : len - sizeof(live->program) + 1;
+	memcpy(live->program, prog_file + skip, len - skip + 1);
+	for (i = 0; i < NUM_STALL_CAUSES; i++) {
+		snprintf(live->stall_names[i], LIVE_NAME_LENGTH, "%s", STALL_NAMES[i]);
+	}
+	window_head = window_count = 0;
+	LIVE_ON = TRUE;
+	live_publish();
+	printf("Publishing statistics to %s every %u cycles\n\n", live_name, interval);
+	return 0;
+}
+
+void live_stop()
+{
+	if (!LIVE_ON) return;
+	live->running = FALSE;
+	LIVE_ON = FALSE;
+	munmap(live, sizeof(Live_Stats));
+	shm_unlink(live_name);
+	printf("Statistics no longer published.\n\n");
+}
+
+/***************************************************************/
+/* Called by cycle() when CYCLE_COUNT reaches LIVE_NEXT or the */
+/* run ends. The window IPC and the time are worked out before */
+/* the write section, which only stores, so readers rarely     */
+/* have to retry.                                              */
+/***************************************************************/
+void live_publish()
+{
+	struct timespec now;
+	uint32_t oldest, seq;
+	uint32_t interval = live->interval;
+
+	/* reset() starts the counters over, so does the window */
+	if (window_count && CYCLE_COUNT < window_cycles[(window_head + LIVE_WINDOW - 1) % LIVE_WINDOW]) window_count = 0;
+	window_cycles[window_head] = CYCLE_COUNT;
+	window_insts[window_head] = INSTRUCTION_COUNT;
+	window_head = (window_head + 1) % LIVE_WINDOW;
+	if (window_count < LIVE_WINDOW) window_count++;
+	oldest = (window_head + LIVE_WINDOW - window_count) % LIVE_WINDOW;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	seq = atomic_load_explicit(&live->seq, memory_order_relaxed);
+	atomic_store_explicit(&live->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	live->running = RUN_FLAG;
+	live->ooo = OOO_ON;
+	live->cycles = CYCLE_COUNT;
+	live->instructions = INSTRUCTION_COUNT;
+	live->pc = CURRENT_STATE.PC;
+	live->branch_flushes = BRANCH_FLUSHES;
+	memcpy(live->stall_cycles, STALL_CYCLES, sizeof(live->stall_cycles));
+	live->window_ipc = CYCLE_COUNT > window_cycles[oldest] ?
+		(double)(INSTRUCTION_COUNT - window_insts[oldest]) / (CYCLE_COUNT - window_cycles[oldest]) : 0.0;
+	live->host_ns = (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+
+	atomic_store_explicit(&live->seq, seq + 2, memory_order_release);
+
+	LIVE_NEXT = CYCLE_COUNT - CYCLE_COUNT % interval + interval;
+}
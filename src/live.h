@@ -0,0 +1,47 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "mu-riscv.h"
+
+/***************************************************************/
+/* Live statistics in a POSIX shared-memory object, published  */
+/* every <interval> cycles for mu-stat and other readers.      */
+/* A seqlock guards the snapshot: the writer makes <seq> odd,  */
+/* updates the fields and makes it even again, readers retry   */
+/* until they copied the fields under one even <seq>.          */
+/***************************************************************/
+#define LIVE_MAGIC 0x4d554c53	/* "MULS" */
+#define LIVE_WINDOW 16		/* updates the window IPC is taken over */
+#define LIVE_NAME_LENGTH 24
+
+typedef struct {
+	uint32_t magic;
+	uint32_t pid;		/* of the simulator, gone when it exits */
+	uint32_t interval;
+	char program[256];	/* the end of the program path */
+	char stall_names[NUM_STALL_CAUSES][LIVE_NAME_LENGTH];
+	_Atomic uint32_t seq;
+
+	/* the snapshot */
+	uint32_t running;
+	uint32_t ooo;
+	uint32_t cycles;
+	uint32_t instructions;
+	uint32_t pc;
+	uint32_t branch_flushes;
+	uint32_t stall_cycles[NUM_STALL_CAUSES];
+	double window_ipc;	/* over the last LIVE_WINDOW updates */
+	uint64_t host_ns;	/* CLOCK_MONOTONIC time of the update */
+} Live_Stats;
+
+extern int LIVE_ON;
+extern uint32_t LIVE_NEXT;	/* cycle of the next update */
+
+int live_start(const char *name, uint32_t interval);
+void live_stop();
+void live_publish();
+
+#endif
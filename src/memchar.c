@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-riscv.h"
+#include "print_inst.h"
+#include "memchar.h"
+
+int MEMCHAR_ON;
+
+static uint32_t line_shift;		/* log2 of the line size */
+static uint32_t ws_interval;		/* instructions per working-set interval */
+static char *out_path;			/* the full results, NULL for the summary only */
+
+/***************************************************************/
+/* Line table: open addressing, line -> last access time and   */
+/* the last working-set interval that touched it              */
+/***************************************************************/
+typedef struct {
+	uint32_t key;		/* line + 1, 0 when empty */
+	uint32_t time;
+	uint32_t interval;
+} Line_Entry;
+
+static Line_Entry *lines;
+static uint32_t lines_cap, lines_used;
+
+/***************************************************************/
+/* Fenwick tree over access times, one mark at the last access */
+/* of every line. The reuse distance of an access is the       */
+/* number of marks between the line's previous access and now. */
+/***************************************************************/
+static uint32_t *fenwick;
+static uint32_t fenwick_cap, now;
+
+/* results */
+static uint64_t reuse_hist[REUSE_BUCKETS];
+static uint64_t loads, stores;
+
+typedef struct {
+	uint32_t interval;
+	uint32_t lines;
+} WS_Sample;
+static WS_Sample *ws;
+static uint32_t ws_count, ws_size, ws_current, ws_lines;
+
+typedef struct {
+	uint32_t accesses;
+	uint32_t last_addr;
+	int32_t stride[4];	/* most frequent strides seen, with their counts */
+	uint32_t count[4];
+} PC_Stride;
+static PC_Stride *strides;
+static uint32_t strides_size;
+
+static void fenwick_add(uint32_t i, int32_t delta)
+{
+	for (i++; i <= fenwick_cap; i += i & -i) fenwick[i - 1] += delta;
+}
+
+/* marks at times [0, i) */
+static uint32_t fenwick_prefix(uint32_t i)
+{
+	uint32_t sum = 0;
+	for (; i > 0; i -= i & -i) sum += fenwick[i - 1];
+	return sum;
+}
+
+static Line_Entry* line_lookup(uint32_t line)
+{
+	uint32_t h = (line * 0x9e3779b1u) & (lines_cap - 1);
+	while (lines[h].key && lines[h].key != line + 1) h = (h + 1) & (lines_cap - 1);
+	return &lines[h];
+}
+
+static void lines_grow()
+{
+	Line_Entry *old = lines;
+	uint32_t old_cap = lines_cap, i;
+
+	lines_cap = old_cap ? old_cap * 2 : 1 << 16;
+	lines = calloc(lines_cap, sizeof(Line_Entry));
+	for (i = 0; i < old_cap; i++) {
+		if (old[i].key) *line_lookup(old[i].key - 1) = old[i];
+	}
+	free(old);
+}
+
+static int by_time(const void *a, const void *b)
+{
+	uint32_t x = (*(Line_Entry * const *)a)->time, y = (*(Line_Entry * const *)b)->time;
+	return (x > y) - (x < y);
+}
+
+/* renumber the live lines 0..n-1 in time order once the tree is full, growing it if half full */
+static void fenwick_compact()
+{
+	Line_Entry **live = malloc(lines_used * sizeof(Line_Entry *));
+	uint32_t n = 0, i;
+
+	for (i = 0; i < lines_cap; i++) {
+		if (lines[i].key) live[n++] = &lines[i];
+	}
+	qsort(live, n, sizeof(Line_Entry *), by_time);
+
+	if (n > fenwick_cap / 2) fenwick_cap *= 2;
+	free(fenwick);
+	fenwick = calloc(fenwick_cap, sizeof(uint32_t));
+	for (i = 0; i < n; i++) {
+		live[i]->time = i;
+		fenwick_add(i, 1);
+	}
+	now = n;
+	free(live);
+}
+
+static uint32_t reuse_bucket(uint32_t distance)
+{
+	uint32_t b = 0;
+	while (distance) {
+		b++;
+		distance >>= 1;
+	}
+	return b;
+}
+
+static void ws_close_interval()
+{
+	if (ws_count == ws_size) {
+		ws_size = ws_size ? ws_size * 2 : 1024;
+		ws = realloc(ws, ws_size * sizeof(WS_Sample));
+	}
+	ws[ws_count].interval = ws_current;
+	ws[ws_count].lines = ws_lines;
+	ws_count++;
+	ws_lines = 0;
+}
+
+static void stride_update(uint32_t pc, uint32_t address)
+{
+	PC_Stride *p;
+	int i, victim = 0;
+	int32_t stride;
+
+	if (!in_program(pc) || (pc - MEM_TEXT_BEGIN) / 4 >= strides_size) return;
+	p = &strides[(pc - MEM_TEXT_BEGIN) / 4];
+	if (p->accesses++ == 0) {
+		p->last_addr = address;
+		return;
+	}
+	stride = (int32_t)(address - p->last_addr);
+	p->last_addr = address;
+	for (i = 0; i < 4; i++) {
+		if (p->count[i] && p->stride[i] == stride) {
+			p->count[i]++;
+			return;
+		}
+		if (p->count[i] < p->count[victim]) victim = i;
+	}
+	p->stride[victim] = stride;
+	p->count[victim] = 1;
+}
+
+/***************************************************************/
+/* Record one data access made by the instruction at <pc>      */
+/***************************************************************/
+void memchar_access(uint32_t pc, uint32_t address, int is_store)
+{
+	uint32_t line = address >> line_shift;
+	uint32_t interval = INSTRUCTION_COUNT / ws_interval;
+	Line_Entry *e;
+
+	if (is_store) stores++;
+	else loads++;
+	stride_update(pc, address);
+
+	if (interval != ws_current) {
+		ws_close_interval();
+		ws_current = interval;
+	}
+
+	if (now == fenwick_cap) fenwick_compact();
+	if ((lines_used + 1) * 4 > lines_cap * 3) lines_grow();
+
+	e = line_lookup(line);
+	if (e->key) {
+		reuse_hist[reuse_bucket(fenwick_prefix(now) - fenwick_prefix(e->time + 1))]++;
+		fenwick_add(e->time, -1);
+		if (e->interval != ws_current) ws_lines++;
+	} else {
+		reuse_hist[REUSE_BUCKETS - 1]++;	/* cold */
+		e->key = line + 1;
+		lines_used++;
+		ws_lines++;
+	}
+	e->time = now;
+	e->interval = ws_current;
+	fenwick_add(now++, 1);
+}
+
+/***************************************************************/
+/* Start a fresh analysis with <line_bytes> lines and a        */
+/* working-set sample every <interval> instructions. The full  */
+/* results go to <path> if given.                              */
+/***************************************************************/
+void memchar_enable(uint32_t line_bytes, uint32_t interval, const char *path)
+{
+	line_shift = 0;
+	while ((2u << line_shift) <= line_bytes) line_shift++;
+	ws_interval = interval ? interval : 1;
+	free(out_path);
+	out_path = path ? strdup(path) : NULL;
+	MEMCHAR_ON = TRUE;
+	memchar_reset();
+	printf("Memory characterization on: %u-byte lines, working set every %u instructions\n\n",
+		1u << line_shift, ws_interval);
+}
+
+void memchar_disable()
+{
+	MEMCHAR_ON = FALSE;
+	free(out_path);
+	out_path = NULL;
+	memchar_reset();
+}
+
+/***************************************************************/
+/* Drop everything recorded so far (called from reset)         */
+/***************************************************************/
+void memchar_reset()
+{
+	free(lines);
+	lines = NULL;
+	lines_cap = lines_used = 0;
+	free(fenwick);
+	fenwick = NULL;
+	fenwick_cap = now = 0;
+	free(ws);
+	ws = NULL;
+	ws_count = ws_size = ws_lines = 0;
+	free(strides);
+	strides = NULL;
+	strides_size = 0;
+	memset(reuse_hist, 0, sizeof(reuse_hist));
+	loads = stores = 0;
+	if (!MEMCHAR_ON) return;
+
+	lines_grow();
+	fenwick_cap = 1 << 20;
+	fenwick = calloc(fenwick_cap, sizeof(uint32_t));
+	ws_current = INSTRUCTION_COUNT / ws_interval;
+	strides_size = PROGRAM_SIZE;
+	strides = calloc(strides_size ? strides_size : 1, sizeof(PC_Stride));
+}
+
+/***************************************************************/
+/* Write the results of the run to <out>                       */
+/***************************************************************/
+static void memchar_write(FILE *out, int brief)
+{
+	uint64_t total = loads + stores, cold = reuse_hist[REUSE_BUCKETS - 1], misses;
+	uint32_t b, i, peak = 0;
+
+	fprintf(out, "# accesses %llu (loads %llu, stores %llu), line %u bytes, distinct lines %u\n",
+		(unsigned long long)total, (unsigned long long)loads, (unsigned long long)stores, 1u << line_shift, lines_used);
+
+	fprintf(out, "\n# reuse distance histogram (distinct lines between accesses to a line)\n");
+	fprintf(out, "# distance\taccesses\n");
+	for (b = 0; b < REUSE_BUCKETS - 1; b++) {
+		if (!reuse_hist[b]) continue;
+		if (b == 0) fprintf(out, "0\t%llu\n", (unsigned long long)reuse_hist[b]);
+		else fprintf(out, "%llu-%llu\t%llu\n", 1ull << (b - 1), (1ull << b) - 1, (unsigned long long)reuse_hist[b]);
+	}
+	fprintf(out, "cold\t%llu\n", (unsigned long long)cold);
+
+	/* a fully associative LRU cache of 2^k lines hits exactly the accesses with distance < 2^k */
+	fprintf(out, "\n# miss-rate curve (fully associative LRU)\n");
+	fprintf(out, "# lines\tbytes\tmisses\tmiss rate\n");
+	misses = total;
+	for (b = 0; b < REUSE_BUCKETS - 1; b++) {
+		misses -= reuse_hist[b];
+		fprintf(out, "%llu\t%llu\t%llu\t%.4f\n", 1ull << b, (1ull << b) << line_shift,
+			(unsigned long long)misses, total ? (double)misses / total : 0.0);
+		if (misses == cold) break;
+	}
+
+	for (i = 0; i < ws_count; i++) if (ws[i].lines > peak) peak = ws[i].lines;
+	if (ws_lines > peak) peak = ws_lines;
+	fprintf(out, "\n# working set per %u instructions: %u samples, peak %u lines (%u bytes)\n",
+		ws_interval, ws_count + (ws_lines != 0), peak, peak << line_shift);
+	if (!brief) {
+		fprintf(out, "# interval\tlines\tbytes\n");
+		for (i = 0; i < ws_count; i++) fprintf(out, "%u\t%u\t%u\n", ws[i].interval, ws[i].lines, ws[i].lines << line_shift);
+		if (ws_lines) fprintf(out, "%u\t%u\t%u\n", ws_current, ws_lines, ws_lines << line_shift);
+	}
+
+	if (brief) return;
+	fprintf(out, "\n# per-PC strides\n");
+	fprintf(out, "# address\taccesses\tstride\tshare\tinstruction\n");
+	for (i = 0; i < strides_size; i++) {
+		PC_Stride *p = &strides[i];
+		int k, top = 0;
+		char *inst;
+		if (!p->accesses) continue;
+		for (k = 1; k < 4; k++) if (p->count[k] > p->count[top]) top = k;
+		inst = inst_to_string(mem_read_32(MEM_TEXT_BEGIN + i * 4));
+		fprintf(out, "0x%08x\t%u\t%d\t%.2f\t%s\n", MEM_TEXT_BEGIN + i * 4, p->accesses, p->stride[top],
+			p->accesses > 1 ? (double)p->count[top] / (p->accesses - 1) : 0.0, inst ? inst : "invalid");
+		free(inst);
+	}
+}
+
+/***************************************************************/
+/* Print a summary, export the full results to the file given  */
+/* to memchar_enable()                                         */
+/***************************************************************/
+void memchar_finish()
+{
+	FILE *fp;
+
+	if (!MEMCHAR_ON) return;
+	memchar_write(stdout, TRUE);
+	if (out_path == NULL) return;
+
+	fp = fopen(out_path, "w");
+	if (fp == NULL) {
+		printf("Error: Can't open memory characterization file %s\n\n", out_path);
+		return;
+	}
+	memchar_write(fp, FALSE);
+	fclose(fp);
+	printf("\nMemory characterization written to %s\n\n", out_path);
+}
@@ -0,0 +1,24 @@
+#ifndef MEMCHAR_H
+#define MEMCHAR_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Online memory-access characterization of the loads and      */
+/* stores that reach MEM():                                    */
+/*  - LRU stack (reuse) distance histogram per cache line,     */
+/*    computed with a Fenwick tree over access times           */
+/*  - working-set size per interval of retired instructions    */
+/*  - per-PC stride patterns                                   */
+/***************************************************************/
+#define REUSE_BUCKETS 34	/* distance 0, then [2^(b-1), 2^b) for b = 1..32, then cold */
+
+extern int MEMCHAR_ON;
+
+void memchar_enable(uint32_t line_bytes, uint32_t interval, const char *path);
+void memchar_disable();
+void memchar_reset();
+void memchar_access(uint32_t pc, uint32_t address, int is_store);
+void memchar_finish();
+
+#endif
@@ -4,10 +4,65 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "mu-riscv.h"
 #include "riscv_utils.h"
 #include "print_inst.h"
+#include "riscv_isa.h"
+#include "simpoint.h"
+#include "profile.h"
+#include "pipeview.h"
+#include "memchar.h"
+#include "reverse.h"
+#include "fuzz.h"
+#include "journal.h"
+#include "server.h"
+#include "live.h"
+#include "parallel.h"
+#include "ooo.h"
+
+/***************************************************************/
+/* Simulator state (declared in mu-riscv.h)                                                        */
+/***************************************************************/
+mem_region_t MEM_REGIONS[NUM_MEM_REGION] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
+	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
+};
+
+CPU_State CURRENT_STATE, NEXT_STATE;
+int RUN_FLAG;
+uint32_t INSTRUCTION_COUNT;
+uint32_t CYCLE_COUNT;
+uint32_t PROGRAM_SIZE;
+
+CPU_Pipeline_Reg IF_ID;
+CPU_Pipeline_Reg ID_EX;
+CPU_Pipeline_Reg EX_MEM;
+CPU_Pipeline_Reg MEM_WB;
+int BRANCH_FLUSH;
+int FETCH_HALT;
+uint32_t FETCH_SEQ;
+
+const char *STALL_NAMES[NUM_STALL_CAUSES] = {
+	"none", "load-use", "mul/div result", "divider busy", "mul/div writeback"
+};
+stall_cause_t STALL_CAUSE;
+uint32_t STALL_CYCLES[NUM_STALL_CAUSES];
+uint32_t BRANCH_FLUSHES;
+
+FU_Unit MULTIPLIER = { "multiplier", 3, 3 };
+FU_Unit DIVIDER = { "divider", 20, 1 };
+
+char prog_file[PATH_MAX];
+int HEADLESS;
+int JSON_OUTPUT;
+
+static char *output_buffer;
+static size_t output_length;
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -19,12 +74,25 @@ void help() {
 	printf("run <n>\t-- simulate program for <n> instructions\n");
 	printf("rdump\t-- dump register values\n");
 	printf("reset\t-- clears all registers/memory and re-loads the program\n");
+	printf("record on|off\t-- record the history rstep and rcontinue step back through (off by default)\n");
+	printf("rstep <n>\t-- step the simulation back <n> cycles\n");
+	printf("rcontinue\t-- step back to the oldest recorded cycle\n");
 	printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
 	printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
 	printf("high <val>\t-- set the HI register to <val>\n");
 	printf("low <val>\t-- set the LO register to <val>\n");
 	printf("print\t-- print the program loaded into memory\n");
 	printf("show\t-- print the current content of the pipeline registers\n");
+	printf("stats\t-- print cycle, stall and functional unit statistics\n");
+	printf("profile [file]\t-- print the per-instruction cycle profile, export it to [file]\n");
+	printf("memchar <line> <n> [file]|off\t-- characterize data accesses: reuse distance over <line>-byte lines, working set every <n> instructions, strides; full results to [file]\n");
+	printf("pipeview <file|off>\t-- log every instruction's pipeline stages to <file> (Konata format)\n");
+	printf("ooo <width> <rob> <iq> <lsq>|off\t-- switch to an out-of-order core of the given width and sizes, or back to the in-order pipeline\n");
+	printf("live <name> <n>|off\t-- publish statistics to shared memory <name> every <n> cycles, watch them with mu-stat <name>\n");
+	printf("latency <mul> <div>\t-- set the multiplier and divider latencies in cycles\n");
+	printf("fuzz <n> <len> <seed> [prefix]\t-- compare the pipeline with the functional model on <n> generated <len>-instruction programs, write failing ones to <prefix>.fuzz<i>.in\n");
+	printf("parallel <n> <warmup> <jobs>\t-- simulate the whole program in <n>-instruction intervals on <jobs> processes (0: one per CPU)\n");
+	printf("sample <n> <warmup> <k> [prefix]\t-- estimate CPI from at most <k> representative <n>-instruction intervals, write <prefix>.bb/.simpoints/.weights\n");
 	printf("?\t-- display help menu\n");
 	printf("quit\t-- exit the simulator\n\n");
 	printf("------------------------------------------------------------------\n\n");
@@ -55,6 +123,7 @@ void mem_write_32(uint32_t address, uint32_t value)
 {
 	int i;
 	uint32_t offset;
+	if (JOURNAL_ON) journal_record(address);
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		if ( (address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end) ) {
 			offset = address - MEM_REGIONS[i].begin;
@@ -72,9 +141,13 @@ void mem_write_32(uint32_t address, uint32_t value)
 /***************************************************************/
 void cycle() {
 	//printf("Cycle count: %d\n", CYCLE_COUNT);;
-	handle_pipeline();
+	if (REVERSE_ON) reverse_begin();
+	if (OOO_ON) ooo_cycle();
+	else handle_pipeline();
 	CURRENT_STATE = NEXT_STATE;
 	CYCLE_COUNT++;
+	if (REVERSE_ON) reverse_end();
+	if (LIVE_ON && (CYCLE_COUNT >= LIVE_NEXT || !RUN_FLAG)) live_publish();
 	//if(CURRENT_STATE.PC > (PROGRAM_SIZE * 4) + MEM_TEXT_BEGIN) RUN_FLAG = false;  //this line would end the program before the final instruction finished
 }
 
@@ -97,6 +170,7 @@ void run(int num_cycles) {
 		}
 		cycle();
 	}
+	if (!RUN_FLAG && MEMCHAR_ON) memchar_finish();
 }
 
 /***************************************************************/
@@ -113,6 +187,7 @@ void runAll() {
 		cycle();
 	}
 	printf("Simulation Finished.\n\n");
+	if (MEMCHAR_ON) memchar_finish();
 }
 
 /***************************************************************/
@@ -121,6 +196,14 @@ void runAll() {
 void mdump(uint32_t start, uint32_t stop) {
 	uint32_t address;
 
+	if (JSON_OUTPUT) {
+		printf("{\"report\":\"mdump\",\"start\":%u,\"stop\":%u,\"words\":[", start, stop);
+		for (address = start; address <= stop; address += 4){
+			printf(address == start ? "%u" : ",%u", mem_read_32(address));
+		}
+		printf("]}\n");
+		return;
+	}
 	printf("-------------------------------------------------------------\n");
 	printf("Memory content [0x%08x..0x%08x] :\n", start, stop);
 	printf("-------------------------------------------------------------\n");
@@ -136,6 +219,14 @@ void mdump(uint32_t start, uint32_t stop) {
 /***************************************************************/
 void rdump() {
 	int i;
+	if (JSON_OUTPUT) {
+		printf("{\"report\":\"rdump\",\"instructions\":%u,\"pc\":%u,\"regs\":[", INSTRUCTION_COUNT, CURRENT_STATE.PC);
+		for (i = 0; i < MIPS_REGS; i++){
+			printf(i ? ",%u" : "%u", CURRENT_STATE.REGS[i]);
+		}
+		printf("],\"hi\":%u,\"lo\":%u}\n", CURRENT_STATE.HI, CURRENT_STATE.LO);
+		return;
+	}
 	printf("-------------------------------------\n");
 	printf("Dumping Register Content\n");
 	printf("-------------------------------------\n");
@@ -162,8 +253,13 @@ void handle_command() {
 	uint32_t register_no;
 	int register_value;
 	int hi_reg_value, lo_reg_value;
+	uint32_t mul_latency, div_latency;
+	uint32_t interval, warmup, max_k, line_bytes;
+	uint32_t cases, length, seed, jobs;
+	uint32_t width, rob_size, iq_size, lsq_size;
+	char path[256];
 
-	printf("MU-RISCV SIM:> ");
+	if (!HEADLESS) printf("MU-RISCV SIM:> ");
 
 	if (scanf("%s", buffer) == EOF){
 		exit(0);
@@ -174,12 +270,41 @@ void handle_command() {
 		case 's':
 			if (buffer[1] == 'h' || buffer[1] == 'H'){
 				show_pipeline();
+			}else if (buffer[1] == 't' || buffer[1] == 'T'){
+				print_stats();
+			}else if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%u %u %u", &interval, &warmup, &max_k) != 3){
+					break;
+				}
+				//optional output prefix on the rest of the line
+				if (scanf("%*[ \t]") != EOF && scanf("%255[^ \t\n]", path) == 1){
+					simpoint_run(interval, warmup, max_k, path);
+				}else {
+					simpoint_run(interval, warmup, max_k, NULL);
+				}
 			}else {
 				runAll();
 			}
 			break;
 		case 'M':
 		case 'm':
+			if (buffer[1] == 'e' || buffer[1] == 'E'){
+				if (scanf("%255s", path) != 1){
+					break;
+				}
+				if (strcmp(path, "off") == 0){
+					memchar_disable();
+				}else if (scanf("%u", &interval) == 1){
+					line_bytes = strtoul(path, NULL, 0);
+					//optional results file on the rest of the line
+					if (scanf("%*[ \t]") != EOF && scanf("%255[^ \t\n]", path) == 1){
+						memchar_enable(line_bytes, interval, path);
+					}else {
+						memchar_enable(line_bytes, interval, NULL);
+					}
+				}
+				break;
+			}
 			if (scanf("%x %x", &start, &stop) != 2){
 				break;
 			}
@@ -198,8 +323,28 @@ void handle_command() {
 		case 'r':
 			if (buffer[1] == 'd' || buffer[1] == 'D'){
 				rdump();
+			}else if((buffer[1] == 'e' || buffer[1] == 'E') && (buffer[2] == 'c' || buffer[2] == 'C')){
+				if (scanf("%255s", path) != 1){
+					break;
+				}
+				if (OOO_ON){
+					printf("Reverse execution only records the in-order pipeline\n\n");
+				}else if (strcmp(path, "off") == 0){
+					reverse_disable();
+					printf("Reverse execution off\n\n");
+				}else {
+					reverse_enable(UNDO_RING_BYTES);
+					if (REVERSE_ON) printf("Recording the last %u MB of history for rstep\n\n", UNDO_RING_BYTES >> 20);
+				}
 			}else if(buffer[1] == 'e' || buffer[1] == 'E'){
 				reset();
+			}else if(buffer[1] == 's' || buffer[1] == 'S'){
+				if (scanf("%u", &cycles) != 1) {
+					break;
+				}
+				reverse_step(cycles);
+			}else if(buffer[1] == 'c' || buffer[1] == 'C'){
+				reverse_step(reverse_history());
 			}
 			else {
 				if (scanf("%d", &cycles) != 1) {
@@ -215,6 +360,7 @@ void handle_command() {
 			}
 			CURRENT_STATE.REGS[register_no] = register_value;
 			NEXT_STATE.REGS[register_no] = register_value;
+			reverse_clear(); //stepping back over the edit would mix old and new state
 			break;
 		case 'H':
 		case 'h':
@@ -223,18 +369,91 @@ void handle_command() {
 			}
 			CURRENT_STATE.HI = hi_reg_value;
 			NEXT_STATE.HI = hi_reg_value;
+			reverse_clear();
 			break;
 		case 'L':
 		case 'l':
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%u %u", &mul_latency, &div_latency) != 2){
+					break;
+				}
+				set_fu_latency(mul_latency, div_latency);
+				reverse_clear();
+				break;
+			}
+			if (buffer[1] == 'i' || buffer[1] == 'I'){
+				if (scanf("%255s", path) != 1){
+					break;
+				}
+				if (strcmp(path, "off") == 0){
+					live_stop();
+				}else if (scanf("%u", &interval) == 1){
+					live_start(path, interval);
+				}
+				break;
+			}
 			if (scanf("%i", &lo_reg_value) != 1){
 				break;
 			}
 			CURRENT_STATE.LO = lo_reg_value;
 			NEXT_STATE.LO = lo_reg_value;
+			reverse_clear();
+			break;
+		case 'F':
+		case 'f':
+			if (scanf("%u %u %u", &cases, &length, &seed) != 3){
+				break;
+			}
+			//optional prefix of the failing test case files on the rest of the line
+			if (scanf("%*[ \t]") != EOF && scanf("%255[^ \t\n]", path) == 1){
+				fuzz_run(cases, length, seed, path);
+			}else {
+				fuzz_run(cases, length, seed, NULL);
+			}
+			break;
+		case 'O':
+		case 'o':
+			if (scanf("%255s", path) != 1){
+				break;
+			}
+			if (strcmp(path, "off") == 0){
+				ooo_disable();
+			}else if (scanf("%u %u %u", &rob_size, &iq_size, &lsq_size) == 3){
+				width = strtoul(path, NULL, 0);
+				if (ooo_enable(width, rob_size, iq_size, lsq_size) != 0){
+					break; //the current run is kept
+				}
+			}else {
+				break;
+			}
+			reset();
 			break;
 		case 'P':
 		case 'p':
-			print_program();
+			if (buffer[1] == 'a' || buffer[1] == 'A'){
+				if (scanf("%u %u %u", &interval, &warmup, &jobs) != 3){
+					break;
+				}
+				parallel_run(interval, warmup, jobs);
+			}else if (buffer[2] == 'o' || buffer[2] == 'O'){
+				//optional export file on the rest of the line
+				if (scanf("%*[ \t]") != EOF && scanf("%255[^ \t\n]", path) == 1){
+					print_profile(path);
+				}else {
+					print_profile(NULL);
+				}
+			}else if (buffer[1] == 'i' || buffer[1] == 'I'){
+				if (scanf("%255s", path) != 1){
+					break;
+				}
+				if (strcmp(path, "off") == 0){
+					pipeview_stop();
+				}else {
+					pipeview_start(path);
+				}
+			}else {
+				print_program();
+			}
 			break;
 		default:
 			printf("Invalid Command.\n");
@@ -256,17 +475,43 @@ void reset() {
 
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+		madvise(MEM_REGIONS[i].mem, region_size, MADV_DONTNEED); //the pages read as zero again
 	}
 
 	/*load program*/
 	load_program();
+	reset_pipeline();
+	memchar_reset();
+	reverse_clear();
+}
+
+/***************************************************************/
+/* Empty the pipeline and units, clear the statistics and restart at the first instruction */
+/***************************************************************/
+void reset_pipeline() {
+	/*flush the pipeline*/
+	memset(&IF_ID, 0, sizeof(IF_ID));
+	memset(&ID_EX, 0, sizeof(ID_EX));
+	memset(&EX_MEM, 0, sizeof(EX_MEM));
+	memset(&MEM_WB, 0, sizeof(MEM_WB));
+	BRANCH_FLUSH = FALSE;
+	FETCH_HALT = FALSE;
+	STALL_CAUSE = STALL_NONE;
+	MULTIPLIER.head = MULTIPLIER.count = MULTIPLIER.ops = MULTIPLIER.busy_cycles = 0;
+	DIVIDER.head = DIVIDER.count = DIVIDER.ops = DIVIDER.busy_cycles = 0;
+
+	/*reset statistics*/
+	memset(STALL_CYCLES, 0, sizeof(STALL_CYCLES));
+	BRANCH_FLUSHES = 0;
+	CYCLE_COUNT = 0;
 
 	/*reset PC*/
 	INSTRUCTION_COUNT = 0;
 	CURRENT_STATE.PC =  MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
 	RUN_FLAG = TRUE;
+	ooo_reset();
+	if (LIVE_ON) live_publish();
 }
 
 /***************************************************************/
@@ -276,8 +521,12 @@ void init_memory() {
 	int i;
 	for (i = 0; i < NUM_MEM_REGION; i++) {
 		uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-		MEM_REGIONS[i].mem = malloc(region_size);
-		memset(MEM_REGIONS[i].mem, 0, region_size);
+		//zero-filled on first touch, only the pages in use are resident, which keeps reset() and fork() cheap
+		MEM_REGIONS[i].mem = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (MEM_REGIONS[i].mem == MAP_FAILED) {
+			printf("Error: Can't allocate %u bytes of memory\n", region_size);
+			exit(-1);
+		}
 	}
 }
 
@@ -302,64 +551,97 @@ void load_program() {
 	while( fscanf(fp, "%x\n", &word) != EOF ) {
 		address = MEM_TEXT_BEGIN + i;
 		mem_write_32(address, word);
-		printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
+		if (!HEADLESS) printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
 		i += 4;
 	}
 	PROGRAM_SIZE = i/4;
+	profile_init();
 	printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
 	fclose(fp);
 }
 
-#define R_ARGS uint32_t rs1, uint32_t rs2
-#define I_ARGS uint32_t rs1, int32_t imm
-#define S_ARGS uint32_t rs1, int32_t imm
+//*************** FUNCTIONAL UNITS **************************
+static FU_Entry* fu_head(FU_Unit *fu){return fu->count ? &fu->q[fu->head] : NULL;}
 
+static void fu_push(FU_Unit *fu, CPU_Pipeline_Reg *latch)
+{
+	FU_Entry *e = &fu->q[(fu->head + fu->count) % MAX_FU_LATENCY];
+	if(REVERSE_ON) reverse_fu_slot(fu, e - fu->q);
+	e->latch = *latch;
+	e->ready_cycle = CYCLE_COUNT + fu->latency - 1;
+	fu->count++;
+	fu->ops++;
+}
 
-//***************** R TYPE INSTRUCTIONS **********************
-static inline uint32_t ADD(R_ARGS){return rs1 + rs2;}
-static inline uint32_t SUB(R_ARGS){return rs1 - rs2;}
-static inline uint32_t XOR(R_ARGS){return rs1 ^ rs2;}
-static inline uint32_t  OR(R_ARGS){return rs1 | rs2;}
-static inline uint32_t AND(R_ARGS){return rs1 & rs2;}
-static inline uint32_t SLL(R_ARGS){return rs1 << rs2;}
-static inline uint32_t SRL(R_ARGS){return rs1 >> rs2;}
-static inline uint32_t SRA(R_ARGS){return rs1 >> rs2;} //TODO: this is actually supposed to extend with the msb, I'll leave it unimplemened for now, but plan to do this later -Trevor
-static inline uint32_t SLT(R_ARGS){return (rs1 < rs2);}
-static inline uint32_t SLU(R_ARGS){return (rs1 < rs2);}//TODO: zero extends, leaving for now similar to last one. I figure these little things can be one of the last things we do - Trevor
+static void fu_pop(FU_Unit *fu)
+{
+	fu->head = (fu->head + 1) % MAX_FU_LATENCY;
+	fu->count--;
+}
 
-//**************** I IMMEDIATE INSTRUCTIONS *****************
-static inline uint32_t ADDI(I_ARGS){return rs1 + imm;}
-static inline uint32_t XORI(I_ARGS){return rs1 ^ imm;}
-static inline uint32_t 	ORI(I_ARGS){return rs1 | imm;}
-static inline uint32_t ANDI(I_ARGS){return rs1 & imm;}
-static inline uint32_t SLLI(I_ARGS){return rs1 << imm;}
-static inline uint32_t SRLI(I_ARGS){return rs1 >> imm;}
-static inline uint32_t SRAI(I_ARGS){return rs1 >> imm;}//TODO: msb extends, also note to self to be careful with the upper immediate bits, might have to mess with those in the function, we'll see. it would make it so much less clean though TwT ...
-static inline uint32_t SLTI(I_ARGS){return rs1 < imm;}
-static inline uint32_t SLTIU(I_ARGS){return rs1 < imm;}//TODO: zero extends
+/* true if an operation in flight in <fu> will write <reg> */
+static bool fu_writes(FU_Unit *fu, uint32_t reg)
+{
+	uint32_t i;
+	for (i = 0; i < fu->count; i++) {
+		if (rd_get(fu->q[(fu->head + i) % MAX_FU_LATENCY].latch.IR) == reg) return true;
+	}
+	return false;
+}
 
+static bool fu_pending(uint32_t reg){return reg != 0 && (fu_writes(&MULTIPLIER, reg) || fu_writes(&DIVIDER, reg));}
 
-//**************** LOAD INSTRUCTIONS ************************
-static inline uint32_t LOAD_GENERAL(I_ARGS){return rs1 + imm;}
+/* the unit whose oldest operation is done, the older one if both are */
+static FU_Unit* fu_completing()
+{
+	FU_Entry *m = fu_head(&MULTIPLIER), *d = fu_head(&DIVIDER);
+	if (m && m->ready_cycle > CYCLE_COUNT) m = NULL;
+	if (d && d->ready_cycle > CYCLE_COUNT) d = NULL;
+	if (m && d) return SEQ_BEFORE(m->latch.seq, d->latch.seq) ? &MULTIPLIER : &DIVIDER;
+	return m ? &MULTIPLIER : (d ? &DIVIDER : NULL);
+}
 
-//**************** STORE INSTRUCTIONS ***********************
-static inline uint32_t STORE_GENERAL(S_ARGS){return rs1 + imm;}
+void set_fu_latency(uint32_t mul_latency, uint32_t div_latency)
+{
+	if (mul_latency < 1) mul_latency = 1;
+	if (mul_latency > MAX_FU_LATENCY) mul_latency = MAX_FU_LATENCY;
+	if (div_latency < 1) div_latency = 1;
+	MULTIPLIER.latency = MULTIPLIER.capacity = mul_latency;
+	DIVIDER.latency = div_latency;
+}
 
-//*************** INSTRUCTION TABLES ************************
-static uint32_t (*R_MAP[10])(R_ARGS) = {ADD,SUB,SLT,SLU,XOR,SRL,SRA,OR,AND};
-static uint32_t (*IIMM_MAP[9])(I_ARGS) = {ADDI,SLLI,SLTI,SLTIU,XORI,SRLI,SRAI,ORI,ANDI};
+//*************** FORWARDING ********************************
+static bool latch_writes(CPU_Pipeline_Reg *latch, uint32_t reg)
+{
+	return latch->IR && isa_writes_rd(latch->desc) && rd_get(latch->IR) == reg;
+}
 
+/* value of <reg> as seen by the instruction in EX */
+static uint32_t forward_operand(uint32_t reg)
+{
+	if (reg == 0) return 0;
+	if (latch_writes(&EX_MEM, reg)) return EX_MEM.ALUOutput;	// unit result leaving EX this cycle
+	if (latch_writes(&MEM_WB, reg))					// instruction that was in EX last cycle
+		return (MEM_WB.desc->iclass == CLASS_LOAD) ? MEM_WB.LMD : MEM_WB.ALUOutput;
+	return NEXT_STATE.REGS[reg];					// already written back this cycle
+}
 
-//*************** HANDLERS **********************************
-static uint32_t r_handler(uint32_t funct3, uint32_t funct7){return R_MAP[funct3 + (funct3>5) + (funct7 >> 6)](EX_MEM.A,EX_MEM.B);}
-static uint32_t iImm_handler(uint32_t funct3)
+/* why the instruction in ID/EX cannot execute this cycle */
+static stall_cause_t ex_hazard(CPU_Pipeline_Reg *in, bool port_taken)
 {
-	uint8_t offset = ( (funct3 == 5) * (EX_MEM.imm >> 5)  ); //this is only here to handle srai
-	//return IIMM_MAP[funct3 + (funct3 > 5) + offset](EX_MEM.A,EX_MEM.imm << 5 | EX_MEM.B); // ?
-	return IIMM_MAP[funct3 + (funct3 > 5) + offset](EX_MEM.A,EX_MEM.imm);
+	const inst_desc_t *d = in->desc;
+	uint32_t rs1 = isa_reads_rs1(d) ? rs1_get(in->IR) : 0;
+	uint32_t rs2 = isa_reads_rs2(d) ? rs2_get(in->IR) : 0;
+	uint32_t rd = isa_writes_rd(d) ? rd_get(in->IR) : 0;
+	bool to_unit = (d->iclass == CLASS_MUL && MULTIPLIER.latency > 1) || (d->iclass == CLASS_DIV && DIVIDER.latency > 1);
+
+	if (fu_pending(rs1) || fu_pending(rs2) || fu_pending(rd)) return STALL_FU_RESULT;
+	if (MEM_WB.IR && MEM_WB.desc->iclass == CLASS_LOAD && rd_get(MEM_WB.IR) != 0 &&
+		(rd_get(MEM_WB.IR) == rs1 || rd_get(MEM_WB.IR) == rs2)) return STALL_LOAD_USE;
+	if (d->iclass == CLASS_DIV && to_unit && DIVIDER.count >= DIVIDER.capacity) return STALL_FU_BUSY;
+	if (port_taken && !to_unit) return STALL_WB_PORT;
+	return STALL_NONE;
 }
-static uint32_t iL_handler(){return LOAD_GENERAL(EX_MEM.A,EX_MEM.imm);}
-static uint32_t s_handler(){return STORE_GENERAL(EX_MEM.A,EX_MEM.imm);}
 
 /************************************************************/
 /* maintain the pipeline                                                                                           */
@@ -367,13 +649,93 @@ static uint32_t s_handler(){return STORE_GENERAL(EX_MEM.A,EX_MEM.imm);}
 void handle_pipeline()
 {
 	/*INSTRUCTION_COUNT should be incremented when instruction is done*/
-	/*Since we do not have branch/jump instructions, INSTRUCTION_COUNT should be incremented in WB stage */
+	/*INSTRUCTION_COUNT is incremented in WB stage, taken branches and jumps flush the younger instructions in EX */
+	/*EX stalls IF and ID on data hazards it cannot forward and on busy functional units */
+
+	CPU_Pipeline_Reg retiring = MEM_WB;
 
 	WB();
 	MEM();
 	EX();
 	ID();
 	IF();
+	profile_cycle(retiring.IR != 0, retiring.PC);
+	if(PIPEVIEW_ON) pipeview_cycle(&retiring);
+	if(FUZZ_ON) fuzz_cover();
+	BRANCH_FLUSH = FALSE;
+	STALL_CAUSE = STALL_NONE;
+
+	/* the program is done once fetch has left the text and the pipeline and units have drained */
+	if(pipeline_empty() && !in_program(NEXT_STATE.PC)) RUN_FLAG = FALSE;
+}
+
+/************************************************************/
+/* true when no instruction is in flight in the pipeline or the units                  */
+/************************************************************/
+int pipeline_empty()
+{
+	if(OOO_ON) return ooo_empty();
+	return !IF_ID.IR && !ID_EX.IR && !EX_MEM.IR && !MEM_WB.IR && !MULTIPLIER.count && !DIVIDER.count;
+}
+
+/************************************************************/
+/* stop fetching and run until every fetched instruction has retired,                  */
+/* CURRENT_STATE.PC is then the next instruction in program order                          */
+/************************************************************/
+void drain_pipeline()
+{
+	FETCH_HALT = TRUE;
+	while(!pipeline_empty()){
+		cycle();
+	}
+	FETCH_HALT = FALSE;
+}
+
+/************************************************************/
+/* execute the instruction at CURRENT_STATE.PC without the pipeline.         */
+/* Only CURRENT_STATE is updated, fast_forward() syncs NEXT_STATE.           */
+/************************************************************/
+const inst_desc_t* step_functional()
+{
+	uint32_t pc = CURRENT_STATE.PC, next_pc;
+	if(!in_program(pc)){
+		RUN_FLAG = FALSE;
+		return NULL;
+	}
+
+	uint32_t inst = mem_read_32(pc);
+	const inst_desc_t *d = isa_decode(inst);
+	uint32_t rd = rd_get(inst);
+	uint32_t result = isa_execute(d, pc, CURRENT_STATE.REGS[rs1_get(inst)], CURRENT_STATE.REGS[rs2_get(inst)],
+		isa_imm(d, inst), &next_pc);
+
+	if(d->iclass == CLASS_LOAD){
+		result = isa_load_extend(d, mem_read_32(result));
+	}
+	else if(d->iclass == CLASS_STORE){
+		uint32_t word = (d->mem_bytes == 4) ? 0 : mem_read_32(result);
+		mem_write_32(result, isa_store_merge(d, word, CURRENT_STATE.REGS[rs2_get(inst)]));
+	}
+	if(isa_writes_rd(d) && rd != 0){
+		CURRENT_STATE.REGS[rd] = result;
+	}
+
+	CURRENT_STATE.PC = next_pc;
+	if(inst) INSTRUCTION_COUNT++; //the pipeline treats an all-zero word as a bubble, it never retires
+	return d;
+}
+
+/************************************************************/
+/* functionally execute until <target> instructions have retired           */
+/************************************************************/
+void fast_forward(uint32_t target)
+{
+	while(RUN_FLAG && INSTRUCTION_COUNT < target){
+		step_functional();
+	}
+	if(!in_program(CURRENT_STATE.PC)) RUN_FLAG = FALSE;
+	NEXT_STATE = CURRENT_STATE;
+	reverse_clear(); //the skipped instructions left no undo records
 }
 
 /************************************************************/
@@ -381,30 +743,17 @@ void handle_pipeline()
 /************************************************************/
 void WB()
 {
-	int lmd = MEM_WB.LMD;
-	int alu = MEM_WB.ALUOutput;
-	int inst = MEM_WB.IR;
-	if(inst){ // do nothing if there is no instruction
-		int opcode = opcode_get(inst);
-		int rd = rd_get(inst); //destination register
-
-		switch(opcode){
-			case 51:{ //register-register instruction
-				NEXT_STATE.REGS[rd] = alu;
-				break;
-			}
-			case 19:{ //register-immediate instruction
-				NEXT_STATE.REGS[rd] = alu;
-				break;
-			}
-			case 3:{ //load instruction
-				NEXT_STATE.REGS[rd] = lmd;
-				break;
-			}
+	if(MEM_WB.IR){ // do nothing if there is no instruction
+		const inst_desc_t *d = MEM_WB.desc;
+		uint32_t rd = rd_get(MEM_WB.IR); //destination register
+
+		if(isa_writes_rd(d) && rd != 0){
+			if(REVERSE_ON) reverse_reg(rd, NEXT_STATE.REGS[rd]);
+			NEXT_STATE.REGS[rd] = (d->iclass == CLASS_LOAD) ? MEM_WB.LMD : MEM_WB.ALUOutput;
 		}
 
 		INSTRUCTION_COUNT++;
-		if(INSTRUCTION_COUNT >= PROGRAM_SIZE) RUN_FLAG = FALSE;
+		profile_retire(MEM_WB.PC);
 	}
 }
 
@@ -414,18 +763,28 @@ void WB()
 void MEM()
 {
 	MEM_WB = EX_MEM;
+	if(!EX_MEM.IR) return;
+	profile_stage(EX_MEM.PC, STAGE_MEM);
 
-	//look in IR register to determine if instruction is load or store
-	switch(opcode_get(EX_MEM.IR)){
-		case 3:{ //Load
+	//look at the decoded instruction to determine if it is a load or store
+	const inst_desc_t *d = EX_MEM.desc;
+	switch(d->iclass){
+		case CLASS_LOAD:{
 			//load: store mem[ALU output] in MEM_WB.LMD register
-			MEM_WB.LMD = mem_read_32(EX_MEM.ALUOutput);
+			MEM_WB.LMD = isa_load_extend(d, mem_read_32(EX_MEM.ALUOutput));
+			if(MEMCHAR_ON) memchar_access(EX_MEM.PC, EX_MEM.ALUOutput, FALSE);
 			break;
 		}
-		case 0x23:{ //Store
-			mem_write_32(EX_MEM.ALUOutput,  EX_MEM.B);
+		case CLASS_STORE:{
+			if(MEMCHAR_ON) memchar_access(EX_MEM.PC, EX_MEM.ALUOutput, TRUE);
+			//sub-word stores only replace the low bytes of the word in memory
+			uint32_t word = (d->mem_bytes == 4) ? 0 : mem_read_32(EX_MEM.ALUOutput);
+			if(REVERSE_ON) reverse_mem(EX_MEM.ALUOutput, mem_read_32(EX_MEM.ALUOutput));
+			mem_write_32(EX_MEM.ALUOutput, isa_store_merge(d, word, EX_MEM.B));
 			break;
 		}
+		default:
+			break;
 	}
 }
 
@@ -434,31 +793,60 @@ void MEM()
 /************************************************************/
 void EX()
 {
-	EX_MEM = ID_EX;
-
-	uint32_t opcode = opcode_get(EX_MEM.IR),funct3 = funct3_get(EX_MEM.IR), funct7 = funct7_get(EX_MEM.IR);
-	EX_MEM.A = CURRENT_STATE.REGS[EX_MEM.A];
-	switch(opcode)
-	{
-		case(0x03):
-			EX_MEM.ALUOutput = iL_handler();
-			break;
-		case(0x13):
-			EX_MEM.ALUOutput = iImm_handler(funct3);
-			break;
-		case(0x23):
-			EX_MEM.ALUOutput = s_handler();
-			break;
-		case(0x33): //register-register
-			EX_MEM.ALUOutput = r_handler(funct3, funct7);
-			break;
-		default:
-			break;
+	FU_Unit *done = fu_completing();
+	bool mul_busy = MULTIPLIER.count > 0, div_busy = DIVIDER.count > 0;
+	uint32_t i;
+
+	for(i = 0; i < MULTIPLIER.count; i++) profile_stage(MULTIPLIER.q[(MULTIPLIER.head + i) % MAX_FU_LATENCY].latch.PC, STAGE_EX);
+	for(i = 0; i < DIVIDER.count; i++) profile_stage(DIVIDER.q[(DIVIDER.head + i) % MAX_FU_LATENCY].latch.PC, STAGE_EX);
+
+	memset(&EX_MEM, 0, sizeof(EX_MEM));
+	if(done){ // a finished multiply/divide leaves EX ahead of anything younger
+		EX_MEM = fu_head(done)->latch;
+		fu_pop(done);
 	}
 
-	// since there are no branch operations yet, we always increment the PC by 4.
-	// when we implement branches, we will use logic in the EX stage to determine NEXT_STATE.PC's value.
-	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
+	if(ID_EX.IR){
+		profile_stage(ID_EX.PC, STAGE_EX);
+		STALL_CAUSE = ex_hazard(&ID_EX, done != NULL);
+		if(STALL_CAUSE != STALL_NONE){
+			STALL_CYCLES[STALL_CAUSE]++;
+			profile_stall(ID_EX.PC, STALL_CAUSE);
+		}
+		else{
+			const inst_desc_t *d = ID_EX.desc;
+			uint32_t next_pc;
+
+			ID_EX.A = forward_operand(rs1_get(ID_EX.IR));
+			ID_EX.B = forward_operand(rs2_get(ID_EX.IR));
+			ID_EX.ALUOutput = isa_execute(d, ID_EX.PC, ID_EX.A, ID_EX.B, ID_EX.imm, &next_pc);
+
+			if(d->iclass == CLASS_MUL && MULTIPLIER.latency > 1){
+				fu_push(&MULTIPLIER, &ID_EX);
+				mul_busy = true;
+			}
+			else if(d->iclass == CLASS_DIV && DIVIDER.latency > 1){
+				fu_push(&DIVIDER, &ID_EX);
+				div_busy = true;
+			}
+			else{
+				if(d->iclass == CLASS_MUL){ MULTIPLIER.ops++; mul_busy = true; }
+				if(d->iclass == CLASS_DIV){ DIVIDER.ops++; div_busy = true; }
+				EX_MEM = ID_EX;
+			}
+
+			// fetch always continues at PC + 4, a taken branch or jump redirects it and squashes IF and ID
+			if(next_pc != ID_EX.PC + 4){
+				NEXT_STATE.PC = next_pc;
+				BRANCH_FLUSH = TRUE;
+				BRANCH_FLUSHES++;
+				profile_flush(ID_EX.PC);
+			}
+		}
+	}
+
+	if(mul_busy) MULTIPLIER.busy_cycles++;
+	if(div_busy) DIVIDER.busy_cycles++;
 }
 
 /************************************************************/
@@ -466,15 +854,22 @@ void EX()
 /************************************************************/
 void ID()
 {
+	if(IF_ID.IR) profile_stage(IF_ID.PC, STAGE_ID);
+	if(STALL_CAUSE != STALL_NONE) return; // hold IF/ID and ID/EX
+	if(BRANCH_FLUSH){
+		if(PIPEVIEW_ON && IF_ID.IR) pipeview_squash(&IF_ID);
+		memset(&ID_EX, 0, sizeof(ID_EX));
+		return;
+	}
 	ID_EX = IF_ID;
-	
+	if(!IF_ID.IR) return;
+
 	uint32_t temp_inst = IF_ID.IR;
-	
-	ID_EX.A = CURRENT_STATE.REGS[rs1_get(temp_inst)]; 
-	ID_EX.B = CURRENT_STATE.REGS[rs2_get(temp_inst)];
-	ID_EX.imm = bigImm_get(temp_inst);
 
-	/*IMPLEMENT THIS*/
+	ID_EX.desc = isa_decode(temp_inst);
+	ID_EX.A = CURRENT_STATE.REGS[rs1_get(temp_inst)];
+	ID_EX.B = CURRENT_STATE.REGS[rs2_get(temp_inst)];
+	ID_EX.imm = isa_imm(ID_EX.desc, temp_inst);
 }
 
 /************************************************************/
@@ -482,9 +877,16 @@ void ID()
 /************************************************************/
 void IF()
 {
-	IF_ID.PC = CURRENT_STATE.PC;	
+	if(STALL_CAUSE != STALL_NONE) return; // hold IF/ID and the PC
+	if(BRANCH_FLUSH || FETCH_HALT || !in_program(CURRENT_STATE.PC)){
+		memset(&IF_ID, 0, sizeof(IF_ID));
+		return;
+	}
+	IF_ID.PC = CURRENT_STATE.PC;
 	IF_ID.IR = mem_read_32(IF_ID.PC);
-
+	IF_ID.seq = FETCH_SEQ++;
+	profile_stage(IF_ID.PC, STAGE_IF);
+	NEXT_STATE.PC = CURRENT_STATE.PC + 4;
 }
 
 
@@ -492,6 +894,7 @@ void IF()
 /* Initialize Memory                                                                                                    */
 /************************************************************/
 void initialize() {
+	isa_init();
 	init_memory();
 	CURRENT_STATE.PC = MEM_TEXT_BEGIN;
 	NEXT_STATE = CURRENT_STATE;
@@ -506,7 +909,9 @@ void print_program(){
 
 	while(i < PROGRAM_SIZE){
 		uint32_t instruction = mem_read_32(temp_pc);
-		printf("%s\n", inst_to_string(instruction));
+		char *inst = inst_to_string(instruction);
+		printf("%s\n", inst ? inst : "invalid");
+		free(inst);
 		temp_pc += 4;
 		i++;
 		//exit loop at some point
@@ -516,42 +921,194 @@ void print_program(){
 /************************************************************/
 /* Print the current pipeline                                                                                    */
 /************************************************************/
+static void show_latch(const char *name, CPU_Pipeline_Reg *latch){
+	char *inst = inst_to_string(latch->IR);
+	if (JSON_OUTPUT) {
+		printf("{\"name\":\"%s\",\"pc\":%u,\"ir\":%u,\"inst\":\"%s\",\"a\":%d,\"b\":%d,\"imm\":%d,\"alu\":%d,\"lmd\":%u}",
+			name, latch->PC, latch->IR, latch->IR ? (inst ? inst : "invalid") : "bubble",
+			latch->A, latch->B, latch->imm, latch->ALUOutput, latch->LMD);
+		free(inst);
+		return;
+	}
+	printf("%s.IR: %s\n", name, latch->IR ? (inst ? inst : "invalid") : "bubble");
+	printf("%s.PC: 0x%08x\n", name, latch->PC);
+	free(inst);
+}
+
 void show_pipeline(){
-		printf("Current PC: %d\n\
-IF/ID.IR: %s\n\
-IF/ID.PC: %d\n\n\
-ID/EX.IR: %s \n\
-ID/EX.A: %d\n\
-ID/EX.B: %d\n\
-ID/EX.imm: %d\n\n\
-EX/MEM.IR: %s\n\
-EX/MEM.A: %d\n\
-EX/MEM.B: %d\n\
-EX/MEM.ALU: %d\n\n\
-MEM/WB.IR: %s\n\
-MEM/WB.ALUOutput: %d\n\n\
-MEM/WB.LMD: %x",
-	CURRENT_STATE.PC, inst_to_string(IF_ID.IR), IF_ID.PC, inst_to_string(ID_EX.IR), ID_EX.A, ID_EX.B, ID_EX.imm,
-	inst_to_string(EX_MEM.IR), EX_MEM.A, EX_MEM.B, EX_MEM.ALUOutput, inst_to_string(MEM_WB.IR), MEM_WB.ALUOutput, MEM_WB.LMD);
+	uint32_t i;
+
+	if(OOO_ON){
+		ooo_show();
+		return;
+	}
+	if(JSON_OUTPUT){
+		printf("{\"report\":\"show\",\"pc\":%u,\"latches\":[", CURRENT_STATE.PC);
+		show_latch("IF/ID", &IF_ID);
+		printf(",");
+		show_latch("ID/EX", &ID_EX);
+		printf(",");
+		show_latch("EX/MEM", &EX_MEM);
+		printf(",");
+		show_latch("MEM/WB", &MEM_WB);
+		for(i = 0; i < MULTIPLIER.count; i++){
+			printf(",");
+			show_latch("MUL", &MULTIPLIER.q[(MULTIPLIER.head + i) % MAX_FU_LATENCY].latch);
+		}
+		for(i = 0; i < DIVIDER.count; i++){
+			printf(",");
+			show_latch("DIV", &DIVIDER.q[(DIVIDER.head + i) % MAX_FU_LATENCY].latch);
+		}
+		printf("]}\n");
+		return;
+	}
+	printf("Current PC: 0x%08x\n\n", CURRENT_STATE.PC);
+	show_latch("IF/ID", &IF_ID);
+	printf("\n");
+	show_latch("ID/EX", &ID_EX);
+	printf("ID/EX.A: %d\nID/EX.B: %d\nID/EX.imm: %d\n\n", ID_EX.A, ID_EX.B, ID_EX.imm);
+	show_latch("EX/MEM", &EX_MEM);
+	printf("EX/MEM.A: %d\nEX/MEM.B: %d\nEX/MEM.ALU: %d\n\n", EX_MEM.A, EX_MEM.B, EX_MEM.ALUOutput);
+	show_latch("MEM/WB", &MEM_WB);
+	printf("MEM/WB.ALUOutput: %d\nMEM/WB.LMD: %x\n\n", MEM_WB.ALUOutput, MEM_WB.LMD);
+	for(i = 0; i < MULTIPLIER.count; i++) show_latch("MUL", &MULTIPLIER.q[(MULTIPLIER.head + i) % MAX_FU_LATENCY].latch);
+	for(i = 0; i < DIVIDER.count; i++) show_latch("DIV", &DIVIDER.q[(DIVIDER.head + i) % MAX_FU_LATENCY].latch);
+}
+
+/************************************************************/
+/* Print cycle, stall and functional unit statistics                            */
+/************************************************************/
+void print_stats(){
+	FU_Unit *units[2] = { &MULTIPLIER, &DIVIDER };
+	uint32_t total_stalls = 0;
+	int i;
+
+	if(JSON_OUTPUT){
+		printf("{\"report\":\"stats\",\"cycles\":%u,\"instructions\":%u,\"cpi\":%.3f,",
+			CYCLE_COUNT, INSTRUCTION_COUNT, INSTRUCTION_COUNT ? (double)CYCLE_COUNT / INSTRUCTION_COUNT : 0.0);
+		if(OOO_ON){
+			ooo_print_stats();
+		}
+		else{
+			printf("\"branch_flushes\":%u,\"stalls\":{", BRANCH_FLUSHES);
+			for (i = STALL_NONE + 1; i < NUM_STALL_CAUSES; i++){
+				printf("%s\"%s\":%u", i > STALL_NONE + 1 ? "," : "", STALL_NAMES[i], STALL_CYCLES[i]);
+			}
+			printf("},");
+		}
+		printf("\"units\":[");
+		for (i = 0; i < 2; i++){
+			printf("%s{\"name\":\"%s\",\"latency\":%u,\"ops\":%u,\"busy_cycles\":%u}", i ? "," : "",
+				units[i]->name, units[i]->latency, units[i]->ops, units[i]->busy_cycles);
+		}
+		printf("]}\n");
+		return;
+	}
+	printf("-------------------------------------\n");
+	printf("Simulation Statistics\n");
+	printf("-------------------------------------\n");
+	printf("Cycles\t\t: %u\n", CYCLE_COUNT);
+	printf("Instructions\t: %u\n", INSTRUCTION_COUNT);
+	printf("CPI\t\t: %.3f\n", INSTRUCTION_COUNT ? (double)CYCLE_COUNT / INSTRUCTION_COUNT : 0.0);
+	if(OOO_ON){
+		ooo_print_stats();
+	}
+	else{
+		printf("Branch flushes\t: %u (%u cycles)\n", BRANCH_FLUSHES, BRANCH_FLUSHES * 2);
+		printf("-------------------------------------\n");
+		printf("[Stall cause]\t\t[Cycles]\n");
+		for (i = STALL_NONE + 1; i < NUM_STALL_CAUSES; i++){
+			printf("%-20s\t: %u\n", STALL_NAMES[i], STALL_CYCLES[i]);
+			total_stalls += STALL_CYCLES[i];
+		}
+		printf("%-20s\t: %u\n", "total", total_stalls);
+		printf("structural\t\t: %u\n", STALL_CYCLES[STALL_FU_BUSY] + STALL_CYCLES[STALL_WB_PORT]);
+	}
+	printf("-------------------------------------\n");
+	printf("[Unit]\t\t[Latency] [Ops]\t[Busy cycles] [Utilization]\n");
+	for (i = 0; i < 2; i++){
+		printf("%-10s\t%u\t  %u\t%u\t      %.1f%%\n", units[i]->name, units[i]->latency, units[i]->ops,
+			units[i]->busy_cycles, CYCLE_COUNT ? 100.0 * units[i]->busy_cycles / CYCLE_COUNT : 0.0);
+	}
+	printf("-------------------------------------\n");
+}
+
+/***************************************************************/
+/* Write the headless output staged in memory with one write() */
+/***************************************************************/
+static void flush_output() {
+	size_t done = 0;
+	ssize_t n;
+
+	fclose(stdout);
+	while (done < output_length) {
+		n = write(STDOUT_FILENO, output_buffer + done, output_length - done);
+		if (n <= 0) break;
+		done += n;
+	}
+	free(output_buffer);
 }
 
 /***************************************************************/
 /* main                                                                                                                                   */
 /***************************************************************/
 int main(int argc, char *argv[]) {
-	printf("\n**************************\n");
-	printf("Welcome to MU-RISCV SIM...\n");
-	printf("**************************\n\n");
+	const char *script = NULL, *commands = NULL;
+	char *buffer;
+	int i;
+
+	if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+		server_run(argv[2], argc >= 4 ? atoi(argv[3]) : SERVER_WORKERS);
+	}
 
-	if (argc < 2) {
-		printf("Error: You should provide input file.\nUsage: %s <input program> \n\n",  argv[0]);
+	for (i = 1; i + 1 < argc && strncmp(argv[i], "--", 2) == 0; i += 2) {
+		if (strcmp(argv[i], "--script") == 0) script = argv[i + 1];
+		else if (strcmp(argv[i], "--exec") == 0) commands = argv[i + 1];
+		else if (strcmp(argv[i], "--format") == 0) JSON_OUTPUT = (strcmp(argv[i + 1], "json") == 0);
+		else break;
+	}
+	HEADLESS = (script != NULL || commands != NULL);
+
+	if (!HEADLESS) {
+		printf("\n**************************\n");
+		printf("Welcome to MU-RISCV SIM...\n");
+		printf("**************************\n\n");
+	}
+
+	if (i != argc - 1) {
+		printf("Error: You should provide input file.\nUsage: %s [--script <file> | --exec \"<commands>\"] [--format text|json] <input program> \n"
+			"       %s --serve <socket> [workers]\n\n", argv[0], argv[0]);
+		exit(1);
+	}
+
+	/* the commands replace the terminal as the input of handle_command() */
+	if (script != NULL && freopen(script, "r", stdin) == NULL) {
+		printf("Error: Can't open script %s\n", script);
 		exit(1);
 	}
+	if (commands != NULL) {
+		buffer = malloc(strlen(commands) + 2);
+		sprintf(buffer, "%s\n", commands);
+		for (i = 0; buffer[i]; i++) {
+			if (buffer[i] == ';') buffer[i] = '\n';
+		}
+		stdin = fmemopen(buffer, strlen(buffer), "r");
+	}
+	if (HEADLESS) {
+		stdout = open_memstream(&output_buffer, &output_length);
+		atexit(flush_output); //runs after the other exit handlers, which may still print
+	}
 
-	strcpy(prog_file, argv[1]);
+	if (strlen(argv[argc - 1]) >= sizeof(prog_file)) {
+		printf("Error: program path %s is too long\n", argv[argc - 1]);
+		exit(1);
+	}
+	strcpy(prog_file, argv[argc - 1]);
+	atexit(pipeview_stop);
+	atexit(live_stop);
 	initialize();
 	load_program();
-	help();
+	if (!HEADLESS) help();
 	while (1){
 		handle_command();
 	}
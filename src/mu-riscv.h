@@ -1,4 +1,9 @@
+#ifndef MU_RISCV_H
+#define MU_RISCV_H
+
 #include <stdint.h>
+#include <limits.h>
+#include "riscv_isa.h"
 
 #define FALSE 0
 #define TRUE  1
@@ -27,15 +32,10 @@ typedef struct {
 	uint8_t *mem;
 } mem_region_t;
 
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
-
 #define NUM_MEM_REGION 4
+
+/* memory will be dynamically allocated at initialization */
+extern mem_region_t MEM_REGIONS[NUM_MEM_REGION];
 #define MIPS_REGS 32
 
 typedef struct CPU_State_Struct {
@@ -53,29 +53,90 @@ typedef struct CPU_Pipeline_Reg_Struct{
 	uint32_t imm;
 	uint32_t ALUOutput;
 	uint32_t LMD;
-	
+	const inst_desc_t *desc; //decoded instruction, set in ID
+	uint32_t seq; //fetch order, set in IF
+
 } CPU_Pipeline_Reg;
 
 /***************************************************************/
 /* CPU State info.                                                                                                               */
 /***************************************************************/
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t CYCLE_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
+extern CPU_State CURRENT_STATE, NEXT_STATE;
+extern int RUN_FLAG;	/* run flag*/
+extern uint32_t INSTRUCTION_COUNT;
+extern uint32_t CYCLE_COUNT;
+extern uint32_t PROGRAM_SIZE; /*in words*/
 
 
 /***************************************************************/
 /* Pipeline Registers.                                                                                                        */
 /***************************************************************/
-CPU_Pipeline_Reg IF_ID;
-CPU_Pipeline_Reg ID_EX;
-CPU_Pipeline_Reg EX_MEM;
-CPU_Pipeline_Reg MEM_WB;
+extern CPU_Pipeline_Reg IF_ID;
+extern CPU_Pipeline_Reg ID_EX;
+extern CPU_Pipeline_Reg EX_MEM;
+extern CPU_Pipeline_Reg MEM_WB;
+extern int BRANCH_FLUSH; /* set by EX on a taken branch/jump, squashes the instructions in IF and ID */
+extern int FETCH_HALT; /* IF inserts bubbles while set, used to drain the pipeline */
+extern uint32_t FETCH_SEQ; /* sequence number of the next fetched instruction */
+
+typedef enum {
+	STAGE_IF,
+	STAGE_ID,
+	STAGE_EX,
+	STAGE_MEM,
+	STAGE_WB,
+	NUM_STAGES
+} pipe_stage_t;
+
+/* true if latch <a> holds an older instruction than latch <b> */
+#define SEQ_BEFORE(a, b) ((int32_t)((a) - (b)) < 0)
+
+/***************************************************************/
+/* Hazards.                                                                                                                    */
+/***************************************************************/
+typedef enum {
+	STALL_NONE,
+	STALL_LOAD_USE,		/* operand comes from the load that is in MEM this cycle */
+	STALL_FU_RESULT,	/* operand or destination still pending in the multiplier/divider */
+	STALL_FU_BUSY,		/* structural: the divider is still working on an earlier divide */
+	STALL_WB_PORT,		/* structural: a multiply/divide result takes the EX/MEM latch this cycle */
+	NUM_STALL_CAUSES
+} stall_cause_t;
+
+extern const char *STALL_NAMES[NUM_STALL_CAUSES];
+extern stall_cause_t STALL_CAUSE; /* set by EX when the instruction in ID/EX cannot leave it, holds IF and ID */
+extern uint32_t STALL_CYCLES[NUM_STALL_CAUSES];
+extern uint32_t BRANCH_FLUSHES; /* taken branches/jumps, each squashes two instructions */
 
-char prog_file[32];
+/***************************************************************/
+/* Multi-cycle functional units.                                                                                  */
+/* The multiplier is pipelined and takes a new operation every cycle,          */
+/* the divider is iterative and holds one operation until it is done.           */
+/* Results rejoin the pipeline in EX/MEM, oldest first, one per cycle.          */
+/***************************************************************/
+#define MAX_FU_LATENCY 64
+
+typedef struct {
+	CPU_Pipeline_Reg latch;	/* instruction and its (already computed) result */
+	uint32_t ready_cycle;	/* first cycle in which the result may leave EX */
+} FU_Entry;
+
+typedef struct {
+	const char *name;
+	uint32_t latency;
+	uint32_t capacity;	/* operations in flight: latency if pipelined, 1 if iterative */
+	FU_Entry q[MAX_FU_LATENCY];
+	uint32_t head, count;
+	uint32_t ops, busy_cycles;
+} FU_Unit;
+
+extern FU_Unit MULTIPLIER;
+extern FU_Unit DIVIDER;
+
+extern char prog_file[PATH_MAX];
+extern int HEADLESS; /* running a --script or --exec command list: no banner, menu, prompt or load echo */
+extern int JSON_OUTPUT; /* --format json: rdump, mdump, show and stats print one JSON object per line */
 
 
 /***************************************************************/
@@ -91,6 +152,7 @@ void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
 void handle_command();
 void reset();
+void reset_pipeline();
 void init_memory();
 void load_program();
 void handle_pipeline(); /*IMPLEMENT THIS*/
@@ -102,4 +164,14 @@ void IF();/*IMPLEMENT THIS*/
 void show_pipeline();/*IMPLEMENT THIS*/
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
+void print_stats();
+int pipeline_empty();
+void drain_pipeline();
+const inst_desc_t* step_functional();
+void fast_forward(uint32_t target);
+void set_fu_latency(uint32_t mul_latency, uint32_t div_latency);
+
+/* true while <addr> lies inside the loaded program text */
+static inline int in_program(uint32_t addr) { return addr >= MEM_TEXT_BEGIN && addr < MEM_TEXT_BEGIN + PROGRAM_SIZE * 4; }
 
+#endif
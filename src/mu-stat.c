@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "live.h"
+
+/***************************************************************/
+/* mu-stat <name> [ms]: live view of the statistics a          */
+/* simulator publishes with "live <name> <n>", refreshed every */
+/* <ms> milliseconds until the simulator exits.                */
+/***************************************************************/
+
+/* copy a consistent snapshot, retrying while the simulator writes */
+static void read_snapshot(const Live_Stats *live, Live_Stats *copy)
+{
+	uint32_t before, after;
+	do {
+		before = atomic_load_explicit(&live->seq, memory_order_acquire);
+		if (before & 1) continue;
+		memcpy(copy, (const void*)live, sizeof(*copy));
+		atomic_thread_fence(memory_order_acquire);
+		after = atomic_load_explicit(&live->seq, memory_order_relaxed);
+		if (before == after) return;
+	} while (1);
+}
+
+static void show(const Live_Stats *s, const Live_Stats *prev)
+{
+	double rate = 0.0;
+	uint32_t i, total = 0;
+
+	if (prev && s->host_ns > prev->host_ns && s->cycles >= prev->cycles) {
+		rate = (s->cycles - prev->cycles) * 1e9 / (s->host_ns - prev->host_ns);
+	}
+	printf("\033[H\033[J");
+	printf("%s (pid %u), %s, %s\n", s->program, s->pid, s->ooo ? "out-of-order" : "in-order",
+		s->running ? "running" : "stopped");
+	printf("-------------------------------------\n");
+	printf("Cycles\t\t: %u\n", s->cycles);
+	printf("Instructions\t: %u\n", s->instructions);
+	printf("PC\t\t: 0x%08x\n", s->pc);
+	printf("IPC\t\t: %.3f\n", s->cycles ? (double)s->instructions / s->cycles : 0.0);
+	printf("Window IPC\t: %.3f\n", s->window_ipc);
+	printf("Speed\t\t: %.0f KHz\n", rate / 1e3);
+	printf("Branch flushes\t: %u\n", s->branch_flushes);
+	printf("-------------------------------------\n");
+	printf("[Stall cause]\t\t[Cycles]\n");
+	for (i = STALL_NONE + 1; i < NUM_STALL_CAUSES; i++) {
+		printf("%-20s\t: %u\n", s->stall_names[i], s->stall_cycles[i]);
+		total += s->stall_cycles[i];
+	}
+	printf("%-20s\t: %u\n", "total", total);
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+	char name[256];
+	Live_Stats *live, snap, prev;
+	int fd, have_prev = 0;
+	uint32_t ms = argc >= 3 ? strtoul(argv[2], NULL, 0) : 500;
+
+	if (argc < 2) {
+		printf("Usage: %s <name> [ms]\n", argv[0]);
+		return 1;
+	}
+	snprintf(name, sizeof(name), "%s%s", argv[1][0] == '/' ? "" : "/", argv[1]);
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		printf("Error: no simulator publishes %s\n", name);
+		return 1;
+	}
+	live = mmap(NULL, sizeof(Live_Stats), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (live == MAP_FAILED || live->magic != LIVE_MAGIC) {
+		printf("Error: %s does not hold simulator statistics\n", name);
+		return 1;
+	}
+
+	/* the mapping outlives the simulator, so its last update is shown */
+	while (1) {
+		read_snapshot(live, &snap);
+		show(&snap, have_prev ? &prev : NULL);
+		if (kill(snap.pid, 0) < 0 && errno == ESRCH) break;
+		prev = snap;
+		have_prev = 1;
+		usleep(ms * 1000);
+	}
+	return 0;
+}
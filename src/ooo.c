@@ -0,0 +1,498 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-riscv.h"
+#include "riscv_utils.h"
+#include "print_inst.h"
+#include "profile.h"
+#include "memchar.h"
+#include "fuzz.h"
+#include "reverse.h"
+#include "ooo.h"
+
+int OOO_ON;
+
+typedef struct {
+	uint32_t width, rob_size, iq_size, lsq_size;
+} OOO_Config;
+
+static OOO_Config cfg;
+static int reverse_was_on;	/* the undo records only know the in-order latches */
+
+typedef enum {
+	ROB_WAITING,	/* in the issue queue */
+	ROB_EXECUTING,
+	ROB_DONE
+} rob_state_t;
+
+typedef struct {
+	CPU_Pipeline_Reg latch;	/* A/B hold the operands once issued, ALUOutput the result or address, LMD the loaded value */
+	rob_state_t state;
+	int src[2];		/* ROB slots producing rs1 and rs2, -1 to read the register file */
+	uint32_t src_seq[2];	/* producer's seq, a different one in the slot means it has committed */
+	uint32_t done_cycle;	/* first cycle its result can be used */
+	uint32_t next_pc;
+} ROB_Entry;
+
+static ROB_Entry rob[OOO_MAX_ROB];
+static uint32_t rob_head, rob_count;
+static int rat[MIPS_REGS];		/* ROB slot of the youngest in-flight writer, -1 if none */
+static uint32_t iq_count, lsq_count;
+static uint32_t div_free;		/* first cycle the divider takes a new operation */
+
+static CPU_Pipeline_Reg fetch_buf[2 * OOO_MAX_WIDTH];
+static uint32_t fetch_head, fetch_count;
+
+/* why dispatch stopped in a cycle */
+typedef enum {
+	DISPATCH_ROB_FULL,
+	DISPATCH_IQ_FULL,
+	DISPATCH_LSQ_FULL,
+	NUM_DISPATCH_STALLS
+} dispatch_stall_t;
+
+/* what kept a cycle from committing anything */
+typedef enum {
+	COMMIT_EMPTY,		/* nothing in the ROB: fetch redirect or end of program */
+	COMMIT_LOAD,
+	COMMIT_MUL,
+	COMMIT_DIV,
+	COMMIT_OTHER,
+	NUM_COMMIT_STALLS
+} commit_stall_t;
+
+static const char *DISPATCH_NAMES[NUM_DISPATCH_STALLS] = { "ROB full", "issue queue full", "LSQ full" };
+static const char *COMMIT_NAMES[NUM_COMMIT_STALLS] = { "ROB empty", "head is a load", "head is a multiply",
+	"head is a divide", "head is other" };
+
+static uint64_t rob_occupancy;
+static uint32_t rob_max, mispredicts, forwarded_loads;
+static uint32_t dispatch_stalls[NUM_DISPATCH_STALLS];
+static uint32_t commit_stalls[NUM_COMMIT_STALLS];
+
+static uint32_t rob_slot(uint32_t i) { return (rob_head + i) % cfg.rob_size; }
+
+static int is_mem(const inst_desc_t *d) { return d->iclass == CLASS_LOAD || d->iclass == CLASS_STORE; }
+
+static uint32_t result_of(const ROB_Entry *e)
+{
+	return (e->latch.desc->iclass == CLASS_LOAD) ? e->latch.LMD : e->latch.ALUOutput;
+}
+
+/***************************************************************/
+/* Switch cycle() over to the out-of-order core                */
+/***************************************************************/
+int ooo_enable(uint32_t width, uint32_t rob_size, uint32_t iq_size, uint32_t lsq_size)
+{
+	if (width < 1 || width > OOO_MAX_WIDTH || rob_size < 1 || rob_size > OOO_MAX_ROB || iq_size < 1 || lsq_size < 1) {
+		printf("Width must be 1..%u and the ROB 1..%u entries\n\n", OOO_MAX_WIDTH, OOO_MAX_ROB);
+		return -1;
+	}
+	cfg.width = width;
+	cfg.rob_size = rob_size;
+	cfg.iq_size = iq_size;
+	cfg.lsq_size = lsq_size;
+	if (!OOO_ON) reverse_was_on = REVERSE_ON;
+	REVERSE_ON = FALSE;
+	OOO_ON = TRUE;
+	printf("Out-of-order core: width %u, ROB %u, issue queue %u, LSQ %u\n\n", width, rob_size, iq_size, lsq_size);
+	return 0;
+}
+
+void ooo_disable()
+{
+	if (OOO_ON) REVERSE_ON = reverse_was_on;
+	OOO_ON = FALSE;
+	printf("In-order pipeline\n\n");
+}
+
+/***************************************************************/
+/* Empty the core and clear its statistics                     */
+/***************************************************************/
+void ooo_reset()
+{
+	int i;
+	rob_head = rob_count = iq_count = lsq_count = 0;
+	fetch_head = fetch_count = 0;
+	div_free = 0;
+	for (i = 0; i < MIPS_REGS; i++) rat[i] = -1;
+
+	rob_occupancy = 0;
+	rob_max = mispredicts = forwarded_loads = 0;
+	memset(dispatch_stalls, 0, sizeof(dispatch_stalls));
+	memset(commit_stalls, 0, sizeof(commit_stalls));
+}
+
+int ooo_empty()
+{
+	return rob_count == 0 && fetch_count == 0;
+}
+
+//***************** OPERANDS *********************************
+static int operand_ready(const ROB_Entry *e, int k)
+{
+	const ROB_Entry *p;
+	if (e->src[k] < 0) return TRUE;
+	p = &rob[e->src[k]];
+	return p->latch.seq != e->src_seq[k] || p->state == ROB_DONE;
+}
+
+static uint32_t operand(const ROB_Entry *e, int k, uint32_t reg)
+{
+	const ROB_Entry *p;
+	if (e->src[k] >= 0) {
+		p = &rob[e->src[k]];
+		if (p->latch.seq == e->src_seq[k]) return result_of(p);
+	}
+	return NEXT_STATE.REGS[reg];	// no writer in flight, or it has committed
+}
+
+/***************************************************************/
+/* Commit: retire up to <width> finished instructions in order */
+/***************************************************************/
+static uint32_t commit()
+{
+	uint32_t n;
+
+	for (n = 0; n < cfg.width && rob_count; n++) {
+		ROB_Entry *e = &rob[rob_head];
+		const inst_desc_t *d = e->latch.desc;
+		uint32_t rd = rd_get(e->latch.IR);
+
+		if (e->state != ROB_DONE) break;
+
+		//accesses are characterized in program order, wrong-path loads never get here
+		if (MEMCHAR_ON && is_mem(d)) memchar_access(e->latch.PC, e->latch.ALUOutput, d->iclass == CLASS_STORE);
+		if (d->iclass == CLASS_STORE) {
+			//sub-word stores only replace the low bytes of the word in memory
+			uint32_t word = (d->mem_bytes == 4) ? 0 : mem_read_32(e->latch.ALUOutput);
+			mem_write_32(e->latch.ALUOutput, isa_store_merge(d, word, e->latch.B));
+		}
+		if (isa_writes_rd(d) && rd != 0) {
+			NEXT_STATE.REGS[rd] = result_of(e);
+			if (rat[rd] == (int)rob_head) rat[rd] = -1;
+		}
+		if (is_mem(d)) lsq_count--;
+
+		INSTRUCTION_COUNT++;
+		profile_retire(e->latch.PC);
+		rob_head = (rob_head + 1) % cfg.rob_size;
+		rob_count--;
+	}
+
+	if (n == 0) {
+		commit_stall_t why = COMMIT_EMPTY;
+		if (rob_count) {
+			switch (rob[rob_head].latch.desc->iclass) {
+				case CLASS_LOAD: why = COMMIT_LOAD; break;
+				case CLASS_MUL: why = COMMIT_MUL; break;
+				case CLASS_DIV: why = COMMIT_DIV; break;
+				default: why = COMMIT_OTHER; break;
+			}
+		}
+		commit_stalls[why]++;
+	}
+	return n;
+}
+
+/* drop everything younger than ROB position <keep> and rebuild the rename table */
+static void squash_after(uint32_t keep)
+{
+	uint32_t i;
+
+	for (i = keep + 1; i < rob_count; i++) {
+		ROB_Entry *e = &rob[rob_slot(i)];
+		if (e->state == ROB_WAITING) iq_count--;
+		if (is_mem(e->latch.desc)) lsq_count--;
+	}
+	rob_count = keep + 1;
+	fetch_count = 0;
+
+	for (i = 0; i < MIPS_REGS; i++) rat[i] = -1;
+	for (i = 0; i < rob_count; i++) {
+		ROB_Entry *e = &rob[rob_slot(i)];
+		uint32_t rd = rd_get(e->latch.IR);
+		if (isa_writes_rd(e->latch.desc) && rd != 0) rat[rd] = rob_slot(i);
+	}
+}
+
+/***************************************************************/
+/* Complete: results whose latency has elapsed become visible. */
+/* A taken branch or jump squashes the fall-through path that  */
+/* was fetched behind it and redirects fetch.                  */
+/***************************************************************/
+static void complete()
+{
+	uint32_t i;
+
+	for (i = 0; i < rob_count; i++) {
+		ROB_Entry *e = &rob[rob_slot(i)];
+		if (e->state != ROB_EXECUTING || e->done_cycle > CYCLE_COUNT) continue;
+		e->state = ROB_DONE;
+
+		if (e->next_pc != e->latch.PC + 4) {
+			squash_after(i);
+			NEXT_STATE.PC = e->next_pc;
+			BRANCH_FLUSHES++;
+			mispredicts++;
+			profile_flush(e->latch.PC);
+			break;
+		}
+	}
+}
+
+/* true if a store to <address> reaches memory, mem_write_32() drops the others */
+static int mapped(uint32_t address)
+{
+	int i;
+	for (i = 0; i < NUM_MEM_REGION; i++) {
+		if (address >= MEM_REGIONS[i].begin && address <= MEM_REGIONS[i].end) return TRUE;
+	}
+	return FALSE;
+}
+
+/* for the load at ROB position <pos>: -1 to wait, 0 to read memory, 1 if *value was forwarded */
+static int load_source(uint32_t pos, uint32_t address, uint32_t *value)
+{
+	int i;
+
+	for (i = (int)pos - 1; i >= 0; i--) {
+		const ROB_Entry *s = &rob[rob_slot(i)];
+		if (s->latch.desc->iclass != CLASS_STORE) continue;
+		if (s->state == ROB_WAITING) return -1;	/* address not known yet */
+		if (s->latch.ALUOutput - address + 3 > 6) continue;	/* the two words do not overlap */
+		if (!mapped(s->latch.ALUOutput)) continue;
+		if (s->latch.ALUOutput == address && s->latch.desc->mem_bytes == 4) {
+			*value = s->latch.B;
+			return 1;
+		}
+		return -1;	/* partial overlap, wait until the store has written memory */
+	}
+	return 0;
+}
+
+/***************************************************************/
+/* Issue: start up to <width> ready instructions, oldest first. */
+/* One multiply and one memory access per cycle, the divider   */
+/* takes a new operation once the previous one is done.        */
+/***************************************************************/
+static uint32_t issue()
+{
+	uint32_t i, issued = 0, next_pc, word = 0;
+	int mem_used = FALSE, mul_used = FALSE, source = 0;
+
+	for (i = 0; i < rob_count && issued < cfg.width; i++) {
+		ROB_Entry *e = &rob[rob_slot(i)];
+		const inst_desc_t *d = e->latch.desc;
+		uint32_t latency = 1;
+
+		if (e->state != ROB_WAITING) continue;
+		if (!operand_ready(e, 0) || !operand_ready(e, 1)) continue;
+
+		switch (d->iclass) {
+			case CLASS_MUL:
+				if (mul_used) continue;
+				latency = MULTIPLIER.latency;
+				break;
+			case CLASS_DIV:
+				if (div_free > CYCLE_COUNT) continue;
+				latency = DIVIDER.latency;
+				break;
+			case CLASS_LOAD:
+			case CLASS_STORE:
+				if (mem_used) continue;
+				break;
+			default:
+				break;
+		}
+
+		e->latch.A = operand(e, 0, rs1_get(e->latch.IR));
+		e->latch.B = operand(e, 1, rs2_get(e->latch.IR));
+		e->latch.ALUOutput = isa_execute(d, e->latch.PC, e->latch.A, e->latch.B, e->latch.imm, &next_pc);
+
+		if (d->iclass == CLASS_LOAD) {
+			source = load_source(i, e->latch.ALUOutput, &word);
+			if (source < 0) continue;
+			if (source == 0) word = mem_read_32(e->latch.ALUOutput);
+			else forwarded_loads++;
+			e->latch.LMD = isa_load_extend(d, word);
+			latency = OOO_LOAD_LATENCY;
+		}
+
+		if (d->iclass == CLASS_MUL) { mul_used = TRUE; MULTIPLIER.ops++; }
+		if (d->iclass == CLASS_DIV) { div_free = CYCLE_COUNT + latency; DIVIDER.ops++; }
+		if (is_mem(d)) mem_used = TRUE;
+
+		e->next_pc = next_pc;
+		e->state = ROB_EXECUTING;
+		e->done_cycle = CYCLE_COUNT + latency;
+		iq_count--;
+		issued++;
+		profile_stage(e->latch.PC, STAGE_EX);
+	}
+	return issued;
+}
+
+/***************************************************************/
+/* Dispatch: decode and rename up to <width> fetched           */
+/* instructions into the ROB, issue queue and LSQ              */
+/***************************************************************/
+static dispatch_stall_t dispatch()
+{
+	uint32_t n, k;
+
+	for (n = 0; n < cfg.width && fetch_count; n++) {
+		CPU_Pipeline_Reg *f = &fetch_buf[fetch_head];
+		const inst_desc_t *d = isa_decode(f->IR);
+		uint32_t slot = rob_slot(rob_count), rd = rd_get(f->IR);
+		uint32_t regs[2] = { isa_reads_rs1(d) ? rs1_get(f->IR) : 0, isa_reads_rs2(d) ? rs2_get(f->IR) : 0 };
+		ROB_Entry *e = &rob[slot];
+
+		if (rob_count == cfg.rob_size) { dispatch_stalls[DISPATCH_ROB_FULL]++; return DISPATCH_ROB_FULL; }
+		if (iq_count == cfg.iq_size) { dispatch_stalls[DISPATCH_IQ_FULL]++; return DISPATCH_IQ_FULL; }
+		if (is_mem(d) && lsq_count == cfg.lsq_size) { dispatch_stalls[DISPATCH_LSQ_FULL]++; return DISPATCH_LSQ_FULL; }
+
+		e->latch = *f;
+		e->latch.desc = d;
+		e->latch.imm = isa_imm(d, f->IR);
+		for (k = 0; k < 2; k++) {
+			e->src[k] = regs[k] ? rat[regs[k]] : -1;
+			e->src_seq[k] = (e->src[k] >= 0) ? rob[e->src[k]].latch.seq : 0;
+		}
+		if (isa_writes_rd(d) && rd != 0) rat[rd] = slot;
+		e->state = ROB_WAITING;
+
+		rob_count++;
+		iq_count++;
+		if (is_mem(d)) lsq_count++;
+		profile_stage(f->PC, STAGE_ID);
+		fetch_head = (fetch_head + 1) % (2 * OOO_MAX_WIDTH);
+		fetch_count--;
+	}
+	return NUM_DISPATCH_STALLS;
+}
+
+/***************************************************************/
+/* Fetch: up to <width> sequential words into the fetch buffer */
+/***************************************************************/
+static void fetch()
+{
+	uint32_t n;
+
+	if (FETCH_HALT) return;
+	for (n = 0; n < cfg.width && fetch_count < 2 * cfg.width && in_program(NEXT_STATE.PC); n++) {
+		CPU_Pipeline_Reg *f = &fetch_buf[(fetch_head + fetch_count) % (2 * OOO_MAX_WIDTH)];
+		memset(f, 0, sizeof(*f));
+		f->PC = NEXT_STATE.PC;
+		f->IR = mem_read_32(f->PC);
+		profile_stage(f->PC, STAGE_IF);
+		NEXT_STATE.PC += 4;
+		if (f->IR == 0) continue;	// a bubble, as in IF(): it takes the fetch slot and never retires
+		f->seq = FETCH_SEQ++;
+		fetch_count++;
+	}
+}
+
+/***************************************************************/
+/* One cycle of the out-of-order core, called by cycle()       */
+/***************************************************************/
+void ooo_cycle()
+{
+	uint32_t i, committed, issued, mispredicted = mispredicts, forwarded = forwarded_loads;
+	int mul_busy = FALSE;
+	dispatch_stall_t stop;
+
+	committed = commit();
+	complete();
+	issued = issue();
+	stop = dispatch();
+	fetch();
+
+	for (i = 0; i < rob_count; i++) {
+		const ROB_Entry *e = &rob[rob_slot(i)];
+		if (e->state == ROB_EXECUTING && e->latch.desc->iclass == CLASS_MUL) { mul_busy = TRUE; break; }
+	}
+	if (mul_busy) MULTIPLIER.busy_cycles++;
+	if (div_free > CYCLE_COUNT) DIVIDER.busy_cycles++;
+	rob_occupancy += rob_count;
+	if (rob_count > rob_max) rob_max = rob_count;
+
+	/* coverage state: the ROB head, how much moved, ROB fill, what happened this cycle */
+	if (FUZZ_ON) {
+		fuzz_cover_state((rob_count ? rob[rob_head].latch.desc->id : 0) |
+			((committed < 7 ? committed : 7) << 6) | ((issued < 7 ? issued : 7) << 9) |
+			((rob_count * 4 / (cfg.rob_size + 1)) << 12) |
+			((mispredicts != mispredicted) << 14) | ((forwarded_loads != forwarded) << 15) |
+			((stop == NUM_DISPATCH_STALLS ? 0 : stop + 1) << 16) |
+			((div_free > CYCLE_COUNT) << 18) | (mul_busy << 19));
+	}
+
+	if (ooo_empty() && !in_program(NEXT_STATE.PC)) RUN_FLAG = FALSE;
+}
+
+/***************************************************************/
+/* Print the reorder buffer, oldest first                      */
+/***************************************************************/
+void ooo_show()
+{
+	static const char *STATES[] = { "waiting", "executing", "done" };
+	uint32_t i;
+
+	if (JSON_OUTPUT) {
+		printf("{\"report\":\"show\",\"pc\":%u,\"rob_count\":%u,\"iq_count\":%u,\"lsq_count\":%u,\"fetch_count\":%u,\"rob\":[",
+			CURRENT_STATE.PC, rob_count, iq_count, lsq_count, fetch_count);
+		for (i = 0; i < rob_count; i++) {
+			const ROB_Entry *e = &rob[rob_slot(i)];
+			char *inst = inst_to_string(e->latch.IR);
+			printf("%s{\"slot\":%u,\"pc\":%u,\"inst\":\"%s\",\"state\":\"%s\",\"result\":%u}", i ? "," : "",
+				rob_slot(i), e->latch.PC, inst ? inst : "invalid", STATES[e->state],
+				e->state != ROB_WAITING ? result_of(e) : 0);
+			free(inst);
+		}
+		printf("]}\n");
+		return;
+	}
+	printf("Fetch PC: 0x%08x\n", CURRENT_STATE.PC);
+	printf("ROB: %u/%u  issue queue: %u/%u  LSQ: %u/%u  fetch buffer: %u\n\n",
+		rob_count, cfg.rob_size, iq_count, cfg.iq_size, lsq_count, cfg.lsq_size, fetch_count);
+	for (i = 0; i < rob_count; i++) {
+		const ROB_Entry *e = &rob[rob_slot(i)];
+		char *inst = inst_to_string(e->latch.IR);
+		printf("[%3u] 0x%08x  %-24s %-10s", rob_slot(i), e->latch.PC, inst ? inst : "invalid", STATES[e->state]);
+		if (e->state != ROB_WAITING) printf(" result: %d", (int32_t)result_of(e));
+		printf("\n");
+		free(inst);
+	}
+	printf("\n");
+}
+
+void ooo_print_stats()
+{
+	int i;
+
+	/* print_stats() has opened the JSON object and closes it */
+	if (JSON_OUTPUT) {
+		printf("\"ooo\":{\"width\":%u,\"rob\":%u,\"iq\":%u,\"lsq\":%u,\"rob_occupancy\":%.1f,\"rob_max\":%u,"
+			"\"mispredicts\":%u,\"forwarded_loads\":%u,\"dispatch_stalls\":{",
+			cfg.width, cfg.rob_size, cfg.iq_size, cfg.lsq_size,
+			CYCLE_COUNT ? (double)rob_occupancy / CYCLE_COUNT : 0.0, rob_max, mispredicts, forwarded_loads);
+		for (i = 0; i < NUM_DISPATCH_STALLS; i++) printf("%s\"%s\":%u", i ? "," : "", DISPATCH_NAMES[i], dispatch_stalls[i]);
+		printf("},\"commit_stalls\":{");
+		for (i = 0; i < NUM_COMMIT_STALLS; i++) printf("%s\"%s\":%u", i ? "," : "", COMMIT_NAMES[i], commit_stalls[i]);
+		printf("}},");
+		return;
+	}
+	printf("IPC\t\t: %.3f\n", CYCLE_COUNT ? (double)INSTRUCTION_COUNT / CYCLE_COUNT : 0.0);
+	printf("Width\t\t: %u (ROB %u, IQ %u, LSQ %u)\n", cfg.width, cfg.rob_size, cfg.iq_size, cfg.lsq_size);
+	printf("ROB occupancy\t: %.1f average, %u max\n", CYCLE_COUNT ? (double)rob_occupancy / CYCLE_COUNT : 0.0, rob_max);
+	printf("Mispredicts\t: %u\n", mispredicts);
+	printf("Forwarded loads\t: %u\n", forwarded_loads);
+	printf("-------------------------------------\n");
+	printf("[Dispatch stall]\t[Cycles]\n");
+	for (i = 0; i < NUM_DISPATCH_STALLS; i++) printf("%-20s\t: %u\n", DISPATCH_NAMES[i], dispatch_stalls[i]);
+	printf("-------------------------------------\n");
+	printf("[No commit]\t\t[Cycles]\n");
+	for (i = 0; i < NUM_COMMIT_STALLS; i++) printf("%-20s\t: %u\n", COMMIT_NAMES[i], commit_stalls[i]);
+}
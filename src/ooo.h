@@ -0,0 +1,30 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Out-of-order core, an alternative to handle_pipeline().     */
+/* Fetch/dispatch/issue/commit <width> instructions per cycle, */
+/* registers renamed onto reorder buffer slots, a unified      */
+/* issue queue and a load/store queue. Fetch predicts          */
+/* fall-through like IF(), taken branches and jumps squash the */
+/* younger instructions when they complete. Stores write       */
+/* memory at commit, loads wait for older store addresses and  */
+/* take the value of an older sw to the same address.          */
+/***************************************************************/
+#define OOO_MAX_WIDTH 8
+#define OOO_MAX_ROB 256
+#define OOO_LOAD_LATENCY 2	/* address then memory, like EX and MEM */
+
+extern int OOO_ON;
+
+int ooo_enable(uint32_t width, uint32_t rob_size, uint32_t iq_size, uint32_t lsq_size); /* 0 on success */
+void ooo_disable();
+void ooo_reset();
+void ooo_cycle();
+int ooo_empty();
+void ooo_show();
+void ooo_print_stats();
+
+#endif
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mu-riscv.h"
+#include "reverse.h"
+#include "pipeview.h"
+#include "memchar.h"
+#include "live.h"
+#include "parallel.h"
+
+typedef struct {
+	uint32_t index;
+	uint32_t cycles;
+	uint32_t instructions;
+	uint32_t branch_flushes;
+	uint32_t stall_cycles[NUM_STALL_CAUSES];
+} Interval_Stats;
+
+static Interval_Stats *results;
+static uint32_t num_results, results_size;
+
+/***************************************************************/
+/* Child: the functional pass stopped <warmup> instructions    */
+/* before <start>. Warm the pipeline up to <start>, then       */
+/* measure until <start> + <interval> retired or the program   */
+/* ended, and write the statistics to <fd>.                    */
+/***************************************************************/
+static void simulate_interval(int fd, uint32_t index, uint32_t start, uint32_t interval)
+{
+	Interval_Stats s;
+	uint32_t cycles, insts, flushes, stalls[NUM_STALL_CAUSES];
+	uint32_t i;
+
+	/* the parent's log writer thread and shared memory stay with the parent */
+	PIPEVIEW_ON = FALSE;
+	LIVE_ON = FALSE;
+
+	while (RUN_FLAG && INSTRUCTION_COUNT < start) cycle();
+	cycles = CYCLE_COUNT;
+	insts = INSTRUCTION_COUNT;
+	flushes = BRANCH_FLUSHES;
+	memcpy(stalls, STALL_CYCLES, sizeof(stalls));
+	while (RUN_FLAG && INSTRUCTION_COUNT < start + interval) cycle();
+
+	s.index = index;
+	s.cycles = CYCLE_COUNT - cycles;
+	s.instructions = INSTRUCTION_COUNT - insts;
+	s.branch_flushes = BRANCH_FLUSHES - flushes;
+	for (i = 0; i < NUM_STALL_CAUSES; i++) s.stall_cycles[i] = STALL_CYCLES[i] - stalls[i];
+	_exit(write(fd, &s, sizeof(s)) == sizeof(s) ? 0 : 1);
+}
+
+/* read the statistics the finished children wrote so far */
+static void collect(int fd)
+{
+	Interval_Stats s;
+	while (read(fd, &s, sizeof(s)) == sizeof(s)) {
+		if (num_results == results_size) {
+			results_size = results_size ? 2 * results_size : 256;
+			results = realloc(results, results_size * sizeof(Interval_Stats));
+		}
+		results[num_results++] = s;
+	}
+}
+
+/***************************************************************/
+/* Simulate the program in <interval>-instruction pieces, at   */
+/* most <jobs> at a time (0: one per online CPU)               */
+/***************************************************************/
+void parallel_run(uint32_t interval, uint32_t warmup, uint32_t jobs)
+{
+	int fds[2], status;
+	uint32_t i, running = 0, spawned = 0, failed = 0;
+	uint32_t cycles = 0, insts = 0, flushes = 0, stalls[NUM_STALL_CAUSES] = { 0 };
+	double cpi, cpi_min = 0, cpi_max = 0;
+	struct timespec t0, t1;
+	int reverse_on = REVERSE_ON, memchar_on = MEMCHAR_ON;
+	pid_t pid;
+
+	if (interval == 0) {
+		printf("Interval length must be positive.\n\n");
+		return;
+	}
+	if (jobs == 0) jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (jobs > PARALLEL_MAX_JOBS) jobs = PARALLEL_MAX_JOBS;
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	num_results = 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	reset();
+	REVERSE_ON = FALSE;
+	MEMCHAR_ON = FALSE;
+	fflush(stdout);
+	for (i = 0; ; i++) {
+		uint32_t start = i * interval;
+		fast_forward(start > warmup ? start - warmup : 0);
+		if (!RUN_FLAG) break;
+
+		/* at most <jobs> children; each writes its few bytes before it exits, the pipe never fills */
+		while (running == jobs) {
+			if (waitpid(-1, &status, 0) < 0) break;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+			running--;
+			collect(fds[0]);
+		}
+		pid = fork();
+		if (pid == 0) {
+			close(fds[0]);
+			simulate_interval(fds[1], i, start, interval);
+		}
+		if (pid < 0) {
+			perror("fork");
+			failed++;
+			break;
+		}
+		running++;
+		spawned++;
+	}
+	while (running && waitpid(-1, &status, 0) > 0) {
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+		running--;
+	}
+	collect(fds[0]);
+	close(fds[0]);
+	close(fds[1]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	for (i = 0; i < num_results; i++) {
+		Interval_Stats *s = &results[i];
+		uint32_t j;
+		cycles += s->cycles;
+		insts += s->instructions;
+		flushes += s->branch_flushes;
+		for (j = 0; j < NUM_STALL_CAUSES; j++) stalls[j] += s->stall_cycles[j];
+		if (s->instructions == 0) continue;
+		cpi = (double)s->cycles / s->instructions;
+		if (cpi_max == 0 || cpi < cpi_min) cpi_min = cpi;
+		if (cpi > cpi_max) cpi_max = cpi;
+	}
+
+	printf("-------------------------------------\n");
+	printf("Intervals\t\t: %u of %u instructions, %u warm-up\n", spawned, interval, warmup);
+	if (failed) printf("Failed intervals\t: %u\n", failed);
+	printf("Jobs\t\t\t: %u\n", jobs);
+	printf("Wall time\t\t: %.3f s\n", (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+	printf("Cycles\t\t\t: %u\n", cycles);
+	printf("Instructions\t\t: %u\n", insts);
+	printf("CPI\t\t\t: %.4f (intervals %.3f to %.3f)\n", insts ? (double)cycles / insts : 0.0, cpi_min, cpi_max);
+	printf("Branch flushes\t\t: %u\n", flushes);
+	if (warmup == 0 && spawned > 1) {
+		printf("Warning: without warm-up each interval starts on an empty pipeline, the totals are off by a\n"
+			"         refill and by the lost unit state at each of the %u interval boundaries\n", spawned - 1);
+	}
+	printf("-------------------------------------\n");
+	printf("[Stall cause]\t\t[Cycles]\n");
+	for (i = STALL_NONE + 1; i < NUM_STALL_CAUSES; i++) printf("%-20s\t: %u\n", STALL_NAMES[i], stalls[i]);
+	printf("-------------------------------------\n");
+
+	REVERSE_ON = reverse_on;
+	MEMCHAR_ON = memchar_on;
+	reset();
+}
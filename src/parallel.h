@@ -0,0 +1,19 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Parallel-in-time simulation of the whole program.           */
+/* A functional pass forks a child process every <interval>    */
+/* instructions, <warmup> instructions ahead of the interval;  */
+/* the fork is the checkpoint, its memory copy-on-write. Each  */
+/* child warms the pipeline up, measures its interval in the   */
+/* detailed pipeline and reports through a pipe. The interval  */
+/* statistics add up to whole-run totals.                      */
+/***************************************************************/
+#define PARALLEL_MAX_JOBS 64	/* children running at once */
+
+void parallel_run(uint32_t interval, uint32_t warmup, uint32_t jobs);
+
+#endif
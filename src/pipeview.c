@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mu-riscv.h"
+#include "print_inst.h"
+#include "pipeview.h"
+
+typedef enum {
+	PV_NEW,		/* arg = PC, inst = instruction word */
+	PV_STAGE,	/* arg = stage */
+	PV_STALL,	/* arg = stall cause */
+	PV_RETIRE,
+	PV_FLUSH
+} pv_kind_t;
+
+/* lanes beyond the five pipeline stages */
+#define PV_STAGE_MUL NUM_STAGES
+#define PV_STAGE_DIV (NUM_STAGES + 1)
+static const char *pv_stage_names[] = { "IF", "ID", "EX", "MEM", "WB", "MUL", "DIV" };
+
+typedef struct {
+	uint32_t cycle;
+	uint32_t seq;
+	uint32_t arg;
+	uint32_t inst;
+	uint32_t kind;
+} PV_Event;
+
+int PIPEVIEW_ON;
+
+static PV_Event *ring;
+static _Atomic uint32_t ring_head;	/* next slot the simulator fills */
+static _Atomic uint32_t ring_tail;	/* next slot the writer drains */
+static _Atomic int writer_stop;
+static pthread_t writer;
+static FILE *pv_out;
+static uint32_t dropped;		/* instructions left out because the ring was nearly full */
+
+/* last stage logged for each in-flight instruction, indexed by seq % PV_WINDOW */
+#define PV_WINDOW 256
+static struct {
+	uint32_t seq;
+	uint8_t valid, stage, stall;
+	uint8_t skip;	/* left out of the log, its events are suppressed */
+} in_flight[PV_WINDOW];
+
+/* instructions leaving the pipeline this cycle, logged at the start of the next */
+static struct {
+	uint32_t seq;
+	pv_kind_t kind;
+} leaving[2];
+static int num_leaving;
+
+/***************************************************************/
+/* Producer side                                               */
+/***************************************************************/
+static uint32_t pv_free()
+{
+	return PV_RING_SIZE - (atomic_load_explicit(&ring_head, memory_order_relaxed) -
+		atomic_load_explicit(&ring_tail, memory_order_acquire));
+}
+
+static void pv_push(pv_kind_t kind, uint32_t cycle, uint32_t seq, uint32_t arg, uint32_t inst)
+{
+	const struct timespec wait = { 0, 50000 };
+	uint32_t head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+	/* the headroom of pv_stage() leaves room for the instructions already in the log, this is a backstop */
+	while (pv_free() == 0) nanosleep(&wait, NULL);
+	ring[head & (PV_RING_SIZE - 1)] = (PV_Event){ cycle, seq, arg, inst, kind };
+	atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+/* log that <latch> spends this cycle in <stage>, introducing it first if it is new */
+static void pv_stage(const CPU_Pipeline_Reg *latch, uint32_t stage)
+{
+	uint32_t slot = latch->seq % PV_WINDOW;
+	if (!in_flight[slot].valid || in_flight[slot].seq != latch->seq) {
+		in_flight[slot].seq = latch->seq;
+		in_flight[slot].valid = 1;
+		in_flight[slot].stage = 0xff;
+		in_flight[slot].stall = STALL_NONE;
+		/* a whole instruction is left out rather than some of its records, which Konata can't load */
+		in_flight[slot].skip = pv_free() < PV_HEADROOM;
+		if (in_flight[slot].skip) {
+			dropped++;
+			return;
+		}
+		pv_push(PV_NEW, CYCLE_COUNT, latch->seq, latch->PC, latch->IR);
+	}
+	if (in_flight[slot].skip) return;
+	if (in_flight[slot].stage != stage) {
+		pv_push(PV_STAGE, CYCLE_COUNT, latch->seq, stage, 0);
+		in_flight[slot].stage = stage;
+	}
+}
+
+static void pv_leave(const CPU_Pipeline_Reg *latch, pv_kind_t kind)
+{
+	in_flight[latch->seq % PV_WINDOW].valid = 0;
+	if (in_flight[latch->seq % PV_WINDOW].skip) return;
+	leaving[num_leaving].seq = latch->seq;
+	leaving[num_leaving].kind = kind;
+	num_leaving++;
+}
+
+static uint32_t unit_stage(const CPU_Pipeline_Reg *latch)
+{
+	if (latch->desc->iclass == CLASS_MUL && MULTIPLIER.latency > 1) return PV_STAGE_MUL;
+	if (latch->desc->iclass == CLASS_DIV && DIVIDER.latency > 1) return PV_STAGE_DIV;
+	return STAGE_EX;
+}
+
+/***************************************************************/
+/* Log where every instruction spent the cycle that just ran.  */
+/* Called at the end of handle_pipeline(), <retired> is the    */
+/* latch that WB consumed this cycle.                          */
+/***************************************************************/
+void pipeview_cycle(const CPU_Pipeline_Reg *retired)
+{
+	int stalled = STALL_CAUSE != STALL_NONE;
+	uint32_t i;
+
+	for (i = 0; i < (uint32_t)num_leaving; i++) {
+		pv_push(leaving[i].kind, CYCLE_COUNT, leaving[i].seq, 0, 0);
+	}
+	num_leaving = 0;
+
+	if (retired->IR) {
+		pv_stage(retired, STAGE_WB);
+		pv_leave(retired, PV_RETIRE);
+	}
+	if (MEM_WB.IR) pv_stage(&MEM_WB, STAGE_MEM);
+	if (EX_MEM.IR) pv_stage(&EX_MEM, unit_stage(&EX_MEM));
+	for (i = 0; i < MULTIPLIER.count; i++) pv_stage(&MULTIPLIER.q[(MULTIPLIER.head + i) % MAX_FU_LATENCY].latch, PV_STAGE_MUL);
+	for (i = 0; i < DIVIDER.count; i++) pv_stage(&DIVIDER.q[(DIVIDER.head + i) % MAX_FU_LATENCY].latch, PV_STAGE_DIV);
+	if (ID_EX.IR) {
+		pv_stage(&ID_EX, stalled ? STAGE_EX : STAGE_ID);
+		if (stalled && !in_flight[ID_EX.seq % PV_WINDOW].skip && in_flight[ID_EX.seq % PV_WINDOW].stall != STALL_CAUSE) {
+			pv_push(PV_STALL, CYCLE_COUNT, ID_EX.seq, STALL_CAUSE, 0);
+			in_flight[ID_EX.seq % PV_WINDOW].stall = STALL_CAUSE;
+		}
+	}
+	if (IF_ID.IR) pv_stage(&IF_ID, stalled ? STAGE_ID : STAGE_IF);
+}
+
+/* the instruction in <latch> was squashed in ID by a taken branch this cycle */
+void pipeview_squash(const CPU_Pipeline_Reg *latch)
+{
+	pv_stage(latch, STAGE_ID);
+	pv_leave(latch, PV_FLUSH);
+}
+
+/***************************************************************/
+/* Consumer side                                               */
+/***************************************************************/
+static void pv_write(const PV_Event *e, uint32_t *cycle, uint32_t *retire_id)
+{
+	if (e->cycle != *cycle) {
+		fprintf(pv_out, "C\t%u\n", e->cycle - *cycle);
+		*cycle = e->cycle;
+	}
+	switch (e->kind) {
+		case PV_NEW: {
+			char *text = inst_to_string(e->inst);
+			fprintf(pv_out, "I\t%u\t%u\t0\n", e->seq, e->seq);
+			fprintf(pv_out, "L\t%u\t0\t%08x: %s\n", e->seq, e->arg, text ? text : "invalid");
+			free(text);
+			break;
+		}
+		case PV_STAGE:
+			fprintf(pv_out, "S\t%u\t0\t%s\n", e->seq, pv_stage_names[e->arg]);
+			break;
+		case PV_STALL:
+			fprintf(pv_out, "L\t%u\t1\tstalled (%s) from cycle %u\n", e->seq, STALL_NAMES[e->arg], e->cycle);
+			break;
+		case PV_RETIRE:
+			fprintf(pv_out, "R\t%u\t%u\t0\n", e->seq, (*retire_id)++);
+			break;
+		case PV_FLUSH:
+			fprintf(pv_out, "R\t%u\t0\t1\n", e->seq);
+			break;
+	}
+}
+
+static void* pv_writer_main(void *arg)
+{
+	const struct timespec idle = { 0, 200000 };
+	uint32_t cycle = 0, retire_id = 0;
+	int started = 0;
+	(void)arg;
+
+	for (;;) {
+		int stop = atomic_load_explicit(&writer_stop, memory_order_acquire);
+		uint32_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+		uint32_t tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+
+		if (tail == head) {
+			if (stop) break;
+			nanosleep(&idle, NULL);
+			continue;
+		}
+		for (; tail != head; tail++) {
+			const PV_Event *e = &ring[tail & (PV_RING_SIZE - 1)];
+			if (!started) {
+				fprintf(pv_out, "C=\t%u\n", e->cycle);
+				cycle = e->cycle;
+				started = 1;
+			}
+			pv_write(e, &cycle, &retire_id);
+		}
+		atomic_store_explicit(&ring_tail, tail, memory_order_release);
+	}
+	fflush(pv_out);
+	return NULL;
+}
+
+/***************************************************************/
+/* Start logging to <path>, returns 0 on success               */
+/***************************************************************/
+int pipeview_start(const char *path)
+{
+	if (PIPEVIEW_ON) pipeview_stop();
+
+	pv_out = fopen(path, "w");
+	if (pv_out == NULL) {
+		printf("Error: Can't open pipeline log %s\n\n", path);
+		return -1;
+	}
+	setvbuf(pv_out, NULL, _IOFBF, 1 << 20);
+	fprintf(pv_out, "Kanata\t0004\n");
+
+	if (!ring) ring = malloc(PV_RING_SIZE * sizeof(PV_Event));
+	atomic_store(&ring_head, 0);
+	atomic_store(&ring_tail, 0);
+	atomic_store(&writer_stop, 0);
+	memset(in_flight, 0, sizeof(in_flight));
+	num_leaving = 0;
+	dropped = 0;
+
+	if (pthread_create(&writer, NULL, pv_writer_main, NULL) != 0) {
+		printf("Error: Can't start the pipeline log writer\n\n");
+		fclose(pv_out);
+		return -1;
+	}
+	PIPEVIEW_ON = TRUE;
+	printf("Logging the pipeline to %s\n\n", path);
+	return 0;
+}
+
+/***************************************************************/
+/* Stop logging and wait for the writer to drain the ring      */
+/***************************************************************/
+void pipeview_stop()
+{
+	int i;
+	if (!PIPEVIEW_ON) return;
+
+	for (i = 0; i < num_leaving; i++) {
+		pv_push(leaving[i].kind, CYCLE_COUNT, leaving[i].seq, 0, 0);
+	}
+	num_leaving = 0;
+	PIPEVIEW_ON = FALSE;
+
+	atomic_store_explicit(&writer_stop, 1, memory_order_release);
+	pthread_join(writer, NULL);
+	fclose(pv_out);
+	if (dropped) printf("Pipeline log: %u instructions left out while the ring buffer was nearly full\n", dropped);
+	printf("Pipeline log closed.\n\n");
+}
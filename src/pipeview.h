@@ -0,0 +1,25 @@
+#ifndef PIPEVIEW_H
+#define PIPEVIEW_H
+
+#include "mu-riscv.h"
+
+/***************************************************************/
+/* Pipeline-viewer log in Konata (Kanata 0004) format.         */
+/* The simulator pushes fixed-size events into a lock-free     */
+/* single-producer/single-consumer ring, a background thread   */
+/* formats them and writes them to disk. The simulator does    */
+/* not wait for it: an instruction that enters the pipeline    */
+/* while the ring is nearly full is left out of the log with   */
+/* all of its records, and pipeview_stop() counts them.        */
+/***************************************************************/
+#define PV_RING_SIZE (1 << 20)	/* events, must be a power of two */
+#define PV_HEADROOM 4096	/* free events kept for the instructions in flight */
+
+extern int PIPEVIEW_ON;
+
+int pipeview_start(const char *path);
+void pipeview_stop();
+void pipeview_cycle(const CPU_Pipeline_Reg *retired);
+void pipeview_squash(const CPU_Pipeline_Reg *latch);
+
+#endif
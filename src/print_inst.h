@@ -1,12 +1,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include <stdio.h>
 #include "riscv_utils.h"
+#include "riscv_isa.h"
 
 char* inst_to_string(uint32_t);
-char* R_print(uint32_t rd, uint32_t f3, uint32_t rs1,uint32_t rs2,uint32_t f7);
-char* ILoad_print(uint32_t rd, uint32_t f3, uint32_t rs1, uint32_t imm);
-char* Iimm_print(uint32_t rd, uint32_t f3, uint32_t rs1, uint32_t imm);
-char* S_print(uint32_t imm4, uint32_t f3, uint32_t rs1, uint32_t rs2, uint32_t imm11);
\ No newline at end of file
+char* R_print(const inst_desc_t *d, uint32_t rd, uint32_t rs1, uint32_t rs2);
+char* I_print(const inst_desc_t *d, uint32_t rd, uint32_t rs1, int32_t imm);
+char* Mem_print(const inst_desc_t *d, uint32_t reg, uint32_t rs1, int32_t imm);
+char* B_print(const inst_desc_t *d, uint32_t rs1, uint32_t rs2, int32_t imm);
+char* U_print(const inst_desc_t *d, uint32_t rd, int32_t imm);
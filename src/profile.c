@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mu-riscv.h"
+#include "print_inst.h"
+#include "profile.h"
+
+PC_Profile *PC_PROFILE;
+
+/***************************************************************/
+/* (Re)allocate zeroed counters for the loaded program         */
+/***************************************************************/
+void profile_init()
+{
+	free(PC_PROFILE);
+	PC_PROFILE = calloc(PROGRAM_SIZE ? PROGRAM_SIZE : 1, sizeof(PC_Profile));
+}
+
+/***************************************************************/
+/* Charge the cycle that just ended to one instruction: the    */
+/* one that retired in it, otherwise the oldest one in flight  */
+/* (the one holding up retirement). Bubbles behind a taken     */
+/* branch are therefore charged to the branch target, the      */
+/* branch itself counts its flushes.                           */
+/***************************************************************/
+void profile_cycle(int retired, uint32_t retired_pc)
+{
+	CPU_Pipeline_Reg *latches[4] = { &MEM_WB, &EX_MEM, &ID_EX, &IF_ID };
+	FU_Entry *heads[2] = { MULTIPLIER.count ? &MULTIPLIER.q[MULTIPLIER.head] : NULL,
+		DIVIDER.count ? &DIVIDER.q[DIVIDER.head] : NULL };
+	CPU_Pipeline_Reg *oldest = NULL;
+	PC_Profile *p;
+	int i;
+
+	if (retired) {
+		p = pc_profile(retired_pc);
+		if (p) p->cycles++;
+		return;
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (latches[i]->IR && (!oldest || SEQ_BEFORE(latches[i]->seq, oldest->seq))) oldest = latches[i];
+	}
+	for (i = 0; i < 2; i++) {
+		if (heads[i] && (!oldest || SEQ_BEFORE(heads[i]->latch.seq, oldest->seq))) oldest = &heads[i]->latch;
+	}
+	if (oldest && (p = pc_profile(oldest->PC))) p->cycles++;
+}
+
+static int by_cycles(const void *a, const void *b)
+{
+	const PC_Profile *x = &PC_PROFILE[*(const uint32_t *)a], *y = &PC_PROFILE[*(const uint32_t *)b];
+	if (x->cycles != y->cycles) return (x->cycles < y->cycles) ? 1 : -1;
+	return (*(const uint32_t *)a > *(const uint32_t *)b) - (*(const uint32_t *)a < *(const uint32_t *)b);
+}
+
+/***************************************************************/
+/* Flat profile sorted by charged cycles, one executed         */
+/* instruction per line, annotated with its disassembly        */
+/***************************************************************/
+void profile_write(FILE *out)
+{
+	uint32_t *order = malloc((PROGRAM_SIZE ? PROGRAM_SIZE : 1) * sizeof(uint32_t));
+	uint32_t n = 0, i, total = 0;
+	int s;
+
+	for (i = 0; i < PROGRAM_SIZE; i++) {
+		total += PC_PROFILE[i].cycles;
+		if (PC_PROFILE[i].cycles || PC_PROFILE[i].retired) order[n++] = i;
+	}
+	qsort(order, n, sizeof(uint32_t), by_cycles);
+
+	fprintf(out, "%%cycles\tcycles\tretired\tCPI\tIF\tID\tEX\tMEM\tWB");
+	for (s = STALL_NONE + 1; s < NUM_STALL_CAUSES; s++) fprintf(out, "\t%s", STALL_NAMES[s]);
+	fprintf(out, "\tflushes\taddress\tinstruction\n");
+
+	for (i = 0; i < n; i++) {
+		PC_Profile *p = &PC_PROFILE[order[i]];
+		uint32_t pc = MEM_TEXT_BEGIN + order[i] * 4;
+		char *inst = inst_to_string(mem_read_32(pc));
+
+		fprintf(out, "%6.2f\t%u\t%u\t%.2f", total ? 100.0 * p->cycles / total : 0.0, p->cycles, p->retired,
+			p->retired ? (double)p->cycles / p->retired : 0.0);
+		for (s = 0; s < NUM_STAGES; s++) fprintf(out, "\t%u", p->stage_cycles[s]);
+		for (s = STALL_NONE + 1; s < NUM_STALL_CAUSES; s++) fprintf(out, "\t%u", p->stall_cycles[s]);
+		fprintf(out, "\t%u\t0x%08x\t%s\n", p->flushes, pc, inst ? inst : "invalid");
+		free(inst);
+	}
+	free(order);
+}
+
+/***************************************************************/
+/* Print the flat profile, and export it to <path> if given    */
+/***************************************************************/
+void print_profile(const char *path)
+{
+	FILE *fp;
+
+	profile_write(stdout);
+	if (path == NULL) return;
+
+	fp = fopen(path, "w");
+	if (fp == NULL) {
+		printf("Error: Can't open profile file %s\n\n", path);
+		return;
+	}
+	profile_write(fp);
+	fclose(fp);
+	printf("\nProfile written to %s\n\n", path);
+}
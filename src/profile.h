@@ -0,0 +1,59 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "mu-riscv.h"
+
+/***************************************************************/
+/* Per-instruction-address counters, kept in a dense array     */
+/* parallel to the text segment (one entry per program word).  */
+/***************************************************************/
+typedef struct {
+	uint32_t cycles;			/* cycles charged to this instruction, see profile_cycle() */
+	uint32_t retired;
+	uint32_t stage_cycles[NUM_STAGES];	/* cycles spent in each stage, summed over executions */
+	uint32_t stall_cycles[NUM_STALL_CAUSES];	/* cycles it was held in EX, by cause */
+	uint32_t flushes;			/* times it squashed the instructions behind it */
+} PC_Profile;
+
+extern PC_Profile *PC_PROFILE;
+
+static inline PC_Profile* pc_profile(uint32_t pc)
+{
+	return in_program(pc) ? &PC_PROFILE[(pc - MEM_TEXT_BEGIN) >> 2] : NULL;
+}
+
+static inline void profile_stage(uint32_t pc, pipe_stage_t stage)
+{
+	PC_Profile *p = pc_profile(pc);
+	if (p) p->stage_cycles[stage]++;
+}
+
+static inline void profile_retire(uint32_t pc)
+{
+	PC_Profile *p = pc_profile(pc);
+	if (p) {
+		p->stage_cycles[STAGE_WB]++;
+		p->retired++;
+	}
+}
+
+static inline void profile_stall(uint32_t pc, stall_cause_t cause)
+{
+	PC_Profile *p = pc_profile(pc);
+	if (p) p->stall_cycles[cause]++;
+}
+
+static inline void profile_flush(uint32_t pc)
+{
+	PC_Profile *p = pc_profile(pc);
+	if (p) p->flushes++;
+}
+
+void profile_init();
+void profile_cycle(int retired, uint32_t retired_pc);
+void profile_write(FILE *out);
+void print_profile(const char *path);
+
+#endif
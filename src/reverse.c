@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mu-riscv.h"
+#include "reverse.h"
+
+int REVERSE_ON;
+
+#define NUM_LATCHES 4
+#define NUM_UNITS 2
+static CPU_Pipeline_Reg * const LATCHES[NUM_LATCHES] = { &IF_ID, &ID_EX, &EX_MEM, &MEM_WB };
+static FU_Unit * const UNITS[NUM_UNITS] = { &MULTIPLIER, &DIVIDER };
+
+/***************************************************************/
+/* Undo record of one cycle:                                   */
+/*   u32 length, Undo_Header, tagged items, u32 length         */
+/* The trailing length lets the ring be walked backward.       */
+/* Latches that were all zero (bubbles) are not stored.        */
+/***************************************************************/
+typedef struct {
+	uint32_t pc, instructions, fetch_seq, flushes;
+	uint8_t run_flag;
+	uint8_t stall;		/* STALL_CYCLES entry this cycle bumped, NUM_STALL_CAUSES if none */
+} Undo_Header;
+
+enum {
+	UNDO_LATCH,	/* u8 latch, Saved_Latch */
+	UNDO_REG,	/* u8 reg, u32 old value */
+	UNDO_MEM,	/* u32 address, u32 old word */
+	UNDO_FU,	/* u8 unit, u32 head, count, ops, busy_cycles */
+	UNDO_SLOT	/* u8 unit, u8 slot, Saved_Latch, u32 ready_cycle */
+};
+
+/* PC, IR, A, B, imm, ALUOutput, LMD, seq, ISA_TABLE index + 1 (0 for no desc) */
+typedef uint32_t Saved_Latch[9];
+
+#define UNDO_RECORD_MAX 1024
+#define UNDO_MAX_ITEMS 64
+
+static uint8_t *ring;
+static uint32_t ring_size, ring_head, ring_used;
+static uint32_t records;		/* cycles that can be undone */
+
+static uint8_t rec[UNDO_RECORD_MAX];	/* record of the cycle being simulated */
+static uint32_t rec_len;
+static uint32_t fu_before[NUM_UNITS][4];
+static uint32_t stalls_before[NUM_STALL_CAUSES];
+
+/***************************************************************/
+/* Everything but memory, every SNAPSHOT_INTERVAL cycles       */
+/***************************************************************/
+typedef struct {
+	int valid;
+	uint32_t cycle;
+	CPU_State state;
+	CPU_Pipeline_Reg latch[NUM_LATCHES];
+	struct {
+		FU_Entry q[MAX_FU_LATENCY];
+		uint32_t head, count, ops, busy_cycles;
+	} unit[NUM_UNITS];
+	uint32_t instructions, fetch_seq, flushes;
+	uint32_t stalls[NUM_STALL_CAUSES];
+	int run_flag;
+} Snapshot;
+
+static Snapshot snapshots[NUM_SNAPSHOTS];
+
+static void ring_put(uint32_t off, const void *src, uint32_t n)
+{
+	uint32_t first = (n < ring_size - off) ? n : ring_size - off;
+	memcpy(ring + off, src, first);
+	memcpy(ring, (const uint8_t*)src + first, n - first);
+}
+
+static void ring_get(uint32_t off, void *dst, uint32_t n)
+{
+	uint32_t first = (n < ring_size - off) ? n : ring_size - off;
+	memcpy(dst, ring + off, first);
+	memcpy((uint8_t*)dst + first, ring, n - first);
+}
+
+static void rec_put(const void *src, uint32_t n)
+{
+	memcpy(rec + rec_len, src, n);
+	rec_len += n;
+}
+
+static void rec_tag(uint8_t tag, uint8_t which)
+{
+	rec[rec_len++] = tag;
+	rec[rec_len++] = which;
+}
+
+static void save_latch(const CPU_Pipeline_Reg *l, Saved_Latch s)
+{
+	s[0] = l->PC; s[1] = l->IR; s[2] = l->A; s[3] = l->B;
+	s[4] = l->imm; s[5] = l->ALUOutput; s[6] = l->LMD; s[7] = l->seq;
+	s[8] = l->desc ? (uint32_t)(l->desc - ISA_TABLE) + 1 : 0;
+}
+
+static void load_latch(CPU_Pipeline_Reg *l, const Saved_Latch s)
+{
+	l->PC = s[0]; l->IR = s[1]; l->A = s[2]; l->B = s[3];
+	l->imm = s[4]; l->ALUOutput = s[5]; l->LMD = s[6]; l->seq = s[7];
+	l->desc = s[8] ? &ISA_TABLE[s[8] - 1] : NULL;
+}
+
+/***************************************************************/
+/* Allocate the history ring and start recording               */
+/***************************************************************/
+void reverse_enable(uint32_t ring_bytes)
+{
+	free(ring);
+	ring = malloc(ring_bytes);
+	if (ring == NULL) {
+		printf("Cannot allocate %u bytes of reverse-execution history\n", ring_bytes);
+		REVERSE_ON = 0;
+		return;
+	}
+	ring_size = ring_bytes;
+	REVERSE_ON = 1;
+	reverse_clear();
+}
+
+/***************************************************************/
+/* Stop recording and free the history                         */
+/***************************************************************/
+void reverse_disable()
+{
+	REVERSE_ON = 0;
+	free(ring);
+	ring = NULL;
+	ring_size = 0;
+	reverse_clear();
+}
+
+/***************************************************************/
+/* Forget the history, used when the state changes outside cycle() */
+/***************************************************************/
+void reverse_clear()
+{
+	int i;
+	ring_head = ring_used = records = 0;
+	for (i = 0; i < NUM_SNAPSHOTS; i++) snapshots[i].valid = 0;
+}
+
+uint32_t reverse_history()
+{
+	return records;
+}
+
+static void take_snapshot()
+{
+	Snapshot *s = &snapshots[(CYCLE_COUNT / SNAPSHOT_INTERVAL) % NUM_SNAPSHOTS];
+	int i;
+
+	s->valid = 1;
+	s->cycle = CYCLE_COUNT;
+	s->state = CURRENT_STATE;
+	for (i = 0; i < NUM_LATCHES; i++) s->latch[i] = *LATCHES[i];
+	for (i = 0; i < NUM_UNITS; i++) {
+		memcpy(s->unit[i].q, UNITS[i]->q, sizeof(s->unit[i].q));
+		s->unit[i].head = UNITS[i]->head;
+		s->unit[i].count = UNITS[i]->count;
+		s->unit[i].ops = UNITS[i]->ops;
+		s->unit[i].busy_cycles = UNITS[i]->busy_cycles;
+	}
+	s->instructions = INSTRUCTION_COUNT;
+	s->fetch_seq = FETCH_SEQ;
+	s->flushes = BRANCH_FLUSHES;
+	memcpy(s->stalls, STALL_CYCLES, sizeof(s->stalls));
+	s->run_flag = RUN_FLAG;
+}
+
+static void restore_snapshot(const Snapshot *s)
+{
+	int i;
+
+	CURRENT_STATE = s->state;
+	NEXT_STATE = s->state;
+	for (i = 0; i < NUM_LATCHES; i++) *LATCHES[i] = s->latch[i];
+	for (i = 0; i < NUM_UNITS; i++) {
+		memcpy(UNITS[i]->q, s->unit[i].q, sizeof(s->unit[i].q));
+		UNITS[i]->head = s->unit[i].head;
+		UNITS[i]->count = s->unit[i].count;
+		UNITS[i]->ops = s->unit[i].ops;
+		UNITS[i]->busy_cycles = s->unit[i].busy_cycles;
+	}
+	INSTRUCTION_COUNT = s->instructions;
+	FETCH_SEQ = s->fetch_seq;
+	BRANCH_FLUSHES = s->flushes;
+	memcpy(STALL_CYCLES, s->stalls, sizeof(s->stalls));
+	RUN_FLAG = s->run_flag;
+	CYCLE_COUNT = s->cycle;
+}
+
+/***************************************************************/
+/* Start the record of a cycle, called before handle_pipeline() */
+/***************************************************************/
+void reverse_begin()
+{
+	static const Saved_Latch empty;
+	Undo_Header h;
+	Saved_Latch s;
+	int i;
+
+	if (CYCLE_COUNT % SNAPSHOT_INTERVAL == 0) take_snapshot();
+
+	rec_len = sizeof(uint32_t);
+	h.pc = CURRENT_STATE.PC;
+	h.instructions = INSTRUCTION_COUNT;
+	h.fetch_seq = FETCH_SEQ;
+	h.flushes = BRANCH_FLUSHES;
+	h.run_flag = RUN_FLAG;
+	h.stall = NUM_STALL_CAUSES;
+	rec_put(&h, sizeof(h));
+
+	for (i = 0; i < NUM_LATCHES; i++) {
+		save_latch(LATCHES[i], s);
+		if (memcmp(s, empty, sizeof(s)) == 0) continue;
+		rec_tag(UNDO_LATCH, i);
+		rec_put(s, sizeof(s));
+	}
+	for (i = 0; i < NUM_UNITS; i++) {
+		fu_before[i][0] = UNITS[i]->head;
+		fu_before[i][1] = UNITS[i]->count;
+		fu_before[i][2] = UNITS[i]->ops;
+		fu_before[i][3] = UNITS[i]->busy_cycles;
+	}
+	memcpy(stalls_before, STALL_CYCLES, sizeof(stalls_before));
+}
+
+void reverse_reg(uint32_t reg, uint32_t old)
+{
+	rec_tag(UNDO_REG, reg);
+	rec_put(&old, sizeof(old));
+}
+
+void reverse_mem(uint32_t address, uint32_t old)
+{
+	rec[rec_len++] = UNDO_MEM;
+	rec_put(&address, sizeof(address));
+	rec_put(&old, sizeof(old));
+}
+
+/* called before a unit overwrites one of its queue slots */
+void reverse_fu_slot(const FU_Unit *fu, uint32_t index)
+{
+	Saved_Latch s;
+	save_latch(&fu->q[index].latch, s);
+	rec_tag(UNDO_SLOT, fu == &DIVIDER);
+	rec[rec_len++] = index;
+	rec_put(s, sizeof(s));
+	rec_put(&fu->q[index].ready_cycle, sizeof(uint32_t));
+}
+
+/***************************************************************/
+/* Close the record of a cycle and append it to the ring,      */
+/* dropping the oldest cycles when it is full                  */
+/***************************************************************/
+void reverse_end()
+{
+	uint32_t i, len, tail, old_len;
+
+	for (i = 0; i < NUM_UNITS; i++) {
+		uint32_t now[4] = { UNITS[i]->head, UNITS[i]->count, UNITS[i]->ops, UNITS[i]->busy_cycles };
+		if (memcmp(now, fu_before[i], sizeof(now)) == 0) continue;
+		rec_tag(UNDO_FU, i);
+		rec_put(fu_before[i], sizeof(fu_before[i]));
+	}
+	for (i = 0; i < NUM_STALL_CAUSES; i++) {
+		if (STALL_CYCLES[i] != stalls_before[i])
+			rec[sizeof(uint32_t) + offsetof(Undo_Header, stall)] = i;
+	}
+
+	len = rec_len + sizeof(uint32_t);
+	memcpy(rec, &len, sizeof(len));
+	rec_put(&len, sizeof(len));
+
+	while (ring_used + len > ring_size) {
+		tail = (ring_head + ring_size - ring_used) % ring_size;
+		ring_get(tail, &old_len, sizeof(old_len));
+		ring_used -= old_len;
+		records--;
+	}
+	ring_put(ring_head, rec, len);
+	ring_head = (ring_head + len) % ring_size;
+	ring_used += len;
+	records++;
+}
+
+static uint32_t item_size(uint8_t tag)
+{
+	switch (tag) {
+		case UNDO_LATCH: return 2 + sizeof(Saved_Latch);
+		case UNDO_REG: return 2 + sizeof(uint32_t);
+		case UNDO_MEM: return 1 + 2 * sizeof(uint32_t);
+		case UNDO_FU: return 2 + 4 * sizeof(uint32_t);
+		default: return 3 + sizeof(Saved_Latch) + sizeof(uint32_t);
+	}
+}
+
+/***************************************************************/
+/* Undo the newest cycle. With mem_only set only the memory    */
+/* writes are taken back, the rest comes from a snapshot.      */
+/***************************************************************/
+static void undo_cycle(int mem_only)
+{
+	uint32_t len, off, items[UNDO_MAX_ITEMS], n = 0, v[4];
+	Undo_Header h;
+	Saved_Latch s;
+	int i;
+
+	ring_get((ring_head + ring_size - sizeof(uint32_t)) % ring_size, &len, sizeof(len));
+	ring_head = (ring_head + ring_size - len) % ring_size;
+	ring_get(ring_head, rec, len);
+	ring_used -= len;
+	records--;
+	CYCLE_COUNT--;
+
+	for (off = sizeof(uint32_t) + sizeof(Undo_Header); off < len - sizeof(uint32_t); off += item_size(rec[off]))
+		items[n++] = off;
+
+	if (!mem_only) {
+		for (i = 0; i < NUM_LATCHES; i++) memset(LATCHES[i], 0, sizeof(CPU_Pipeline_Reg));
+	}
+
+	/* newest first, so the oldest value of a location wins */
+	while (n--) {
+		uint8_t *p = rec + items[n];
+		if (p[0] == UNDO_MEM) {
+			memcpy(v, p + 1, 2 * sizeof(uint32_t));
+			mem_write_32(v[0], v[1]);
+			continue;
+		}
+		if (mem_only) continue;
+		switch (p[0]) {
+			case UNDO_LATCH:
+				memcpy(s, p + 2, sizeof(s));
+				load_latch(LATCHES[p[1]], s);
+				break;
+			case UNDO_REG:
+				memcpy(&CURRENT_STATE.REGS[p[1]], p + 2, sizeof(uint32_t));
+				break;
+			case UNDO_FU:
+				memcpy(v, p + 2, sizeof(v));
+				UNITS[p[1]]->head = v[0];
+				UNITS[p[1]]->count = v[1];
+				UNITS[p[1]]->ops = v[2];
+				UNITS[p[1]]->busy_cycles = v[3];
+				break;
+			case UNDO_SLOT:
+				memcpy(s, p + 3, sizeof(s));
+				load_latch(&UNITS[p[1]]->q[p[2]].latch, s);
+				memcpy(&UNITS[p[1]]->q[p[2]].ready_cycle, p + 3 + sizeof(s), sizeof(uint32_t));
+				break;
+		}
+	}
+	if (mem_only) return;
+
+	memcpy(&h, rec + sizeof(uint32_t), sizeof(h));
+	CURRENT_STATE.PC = h.pc;
+	NEXT_STATE = CURRENT_STATE;
+	INSTRUCTION_COUNT = h.instructions;
+	FETCH_SEQ = h.fetch_seq;
+	BRANCH_FLUSHES = h.flushes;
+	RUN_FLAG = h.run_flag;
+	if (h.stall < NUM_STALL_CAUSES) STALL_CYCLES[h.stall]--;
+}
+
+/***************************************************************/
+/* Move <n> cycles back (at most to the oldest recorded cycle) */
+/***************************************************************/
+void reverse_step(uint32_t n)
+{
+	uint32_t target, s;
+	const Snapshot *snap;
+
+	if (!REVERSE_ON) {
+		printf("Reverse execution is not recording, turn it on with record on\n\n");
+		return;
+	}
+	if (n > records) n = records;
+	target = CYCLE_COUNT - n;
+
+	/* the first snapshot at or after the target, if it is still in the ring */
+	s = (target + SNAPSHOT_INTERVAL - 1) / SNAPSHOT_INTERVAL * SNAPSHOT_INTERVAL;
+	snap = &snapshots[(s / SNAPSHOT_INTERVAL) % NUM_SNAPSHOTS];
+	if (s < CYCLE_COUNT && snap->valid && snap->cycle == s) {
+		while (CYCLE_COUNT > s) undo_cycle(1);
+		restore_snapshot(snap);
+	}
+	while (CYCLE_COUNT > target) undo_cycle(0);
+
+	printf("Stepped back %u cycles to cycle %u (%u cycles of history left)\n\n", n, CYCLE_COUNT, records);
+}
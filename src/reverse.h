@@ -0,0 +1,35 @@
+#ifndef REVERSE_H
+#define REVERSE_H
+
+#include <stdint.h>
+#include "mu-riscv.h"
+
+/***************************************************************/
+/* Reverse execution.                                          */
+/* Every cycle appends an undo record to a bounded ring: the   */
+/* latches, PC and counters it started from, the old value of  */
+/* the register written in WB, of the word written in MEM and  */
+/* of any unit state it changed. Every SNAPSHOT_INTERVAL       */
+/* cycles everything but memory is also saved whole, so a long */
+/* jump back only replays the memory undos down to the nearest */
+/* snapshot and then steps the remaining cycles one by one.    */
+/* Recording is off until the record command turns it on.      */
+/***************************************************************/
+#define UNDO_RING_BYTES (32 << 20)	/* about 200k cycles of history */
+#define SNAPSHOT_INTERVAL 4096
+#define NUM_SNAPSHOTS 64
+
+extern int REVERSE_ON;
+
+void reverse_enable(uint32_t ring_bytes);
+void reverse_disable();
+void reverse_clear();
+void reverse_begin();
+void reverse_end();
+void reverse_reg(uint32_t reg, uint32_t old);
+void reverse_mem(uint32_t address, uint32_t old);
+void reverse_fu_slot(const FU_Unit *fu, uint32_t index);
+void reverse_step(uint32_t n);
+uint32_t reverse_history();
+
+#endif
@@ -0,0 +1,179 @@
+#include <stddef.h>
+#include <assert.h>
+
+#include "riscv_isa.h"
+#include "riscv_utils.h"
+
+#define R_ARGS uint32_t rs1, uint32_t rs2
+
+//***************** ALU OPERATIONS ***************************
+// I-type instructions share these with their R-type forms, the immediate is passed as rs2
+static uint32_t ADD(R_ARGS){return rs1 + rs2;}
+static uint32_t SUB(R_ARGS){return rs1 - rs2;}
+static uint32_t XOR(R_ARGS){return rs1 ^ rs2;}
+static uint32_t  OR(R_ARGS){return rs1 | rs2;}
+static uint32_t AND(R_ARGS){return rs1 & rs2;}
+static uint32_t SLL(R_ARGS){return rs1 << (rs2 & 0x1f);}
+static uint32_t SRL(R_ARGS){return rs1 >> (rs2 & 0x1f);}
+static uint32_t SRA(R_ARGS){return (uint32_t)((int32_t)rs1 >> (rs2 & 0x1f));}
+static uint32_t SLT(R_ARGS){return (int32_t)rs1 < (int32_t)rs2;}
+static uint32_t SLTU(R_ARGS){return rs1 < rs2;}
+
+//***************** BRANCH COMPARISONS ***********************
+static uint32_t  EQ(R_ARGS){return rs1 == rs2;}
+static uint32_t  NE(R_ARGS){return rs1 != rs2;}
+static uint32_t  GE(R_ARGS){return (int32_t)rs1 >= (int32_t)rs2;}
+static uint32_t GEU(R_ARGS){return rs1 >= rs2;}
+
+//***************** MULTIPLY / DIVIDE ************************
+// division by zero and overflow follow the RISC-V spec instead of trapping
+static uint32_t    MUL(R_ARGS){return rs1 * rs2;}
+static uint32_t   MULH(R_ARGS){return (uint32_t)(((int64_t)(int32_t)rs1 * (int64_t)(int32_t)rs2) >> 32);}
+static uint32_t MULHSU(R_ARGS){return (uint32_t)(((int64_t)(int32_t)rs1 * (int64_t)rs2) >> 32);}
+static uint32_t  MULHU(R_ARGS){return (uint32_t)(((uint64_t)rs1 * (uint64_t)rs2) >> 32);}
+static uint32_t DIV(R_ARGS)
+{
+	if(rs2 == 0) return 0xffffffff;
+	if(rs1 == 0x80000000 && rs2 == 0xffffffff) return rs1;
+	return (uint32_t)((int32_t)rs1 / (int32_t)rs2);
+}
+static uint32_t DIVU(R_ARGS){return rs2 ? rs1 / rs2 : 0xffffffff;}
+static uint32_t REM(R_ARGS)
+{
+	if(rs2 == 0) return rs1;
+	if(rs1 == 0x80000000 && rs2 == 0xffffffff) return 0;
+	return (uint32_t)((int32_t)rs1 % (int32_t)rs2);
+}
+static uint32_t REMU(R_ARGS){return rs2 ? rs1 % rs2 : rs1;}
+
+//*************** INSTRUCTION TABLES ************************
+#define INST_ENTRY(id, name, mask, match, fmt, cls, op, bytes, sign) \
+	[INST_##id] = { INST_##id, name, mask, match, fmt, cls, op, bytes, sign },
+const inst_desc_t ISA_TABLE[NUM_INSTS] = {
+	RISCV_ISA(INST_ENTRY)
+};
+#undef INST_ENTRY
+
+uint8_t DECODE_TABLE[1 << DECODE_KEY_BITS];
+
+/***************************************************************/
+/* Build the dense decode table from the description table     */
+/***************************************************************/
+void isa_init()
+{
+	const uint32_t key_mask = 0x4200707f; /* the instruction bits covered by decode_key() */
+	uint32_t key;
+	int i;
+
+	for (key = 0; key < (1 << DECODE_KEY_BITS); key++) {
+		/* a representative instruction word for this key */
+		uint32_t inst = ((key & 0x01f) << 2) | 0x3 |
+				((key & 0x0e0) << 7) |
+				((key & 0x100) << 22) |
+				((key & 0x200) << 16);
+		assert(decode_key(inst) == key);
+
+		DECODE_TABLE[key] = INST_INVALID;
+		for (i = INST_INVALID + 1; i < NUM_INSTS; i++) {
+			const inst_desc_t *d = &ISA_TABLE[i];
+			if (((inst ^ d->match) & d->mask & key_mask) == 0) {
+				assert(DECODE_TABLE[key] == INST_INVALID); /* encodings must not overlap */
+				DECODE_TABLE[key] = i;
+			}
+		}
+	}
+}
+
+/***************************************************************/
+/* Extract the sign-extended immediate of an instruction       */
+/***************************************************************/
+int32_t isa_imm(const inst_desc_t *d, uint32_t inst)
+{
+	switch (d->format) {
+		case FMT_I:
+			return (int32_t)inst >> 20;
+		case FMT_SHAMT:
+			return rs2_get(inst);
+		case FMT_S:
+			return ((int32_t)(inst & 0xfe000000) >> 20) | rd_get(inst);
+		case FMT_B:
+			return ((int32_t)(inst & 0x80000000) >> 19) |
+				((inst & 0x80) << 4) |		/* imm[11]   */
+				((inst >> 20) & 0x7e0) |	/* imm[10:5] */
+				((inst >> 7) & 0x1e);		/* imm[4:1]  */
+		case FMT_U:
+			return inst & 0xfffff000;
+		case FMT_J:
+			return ((int32_t)(inst & 0x80000000) >> 11) |
+				(inst & 0xff000) |		/* imm[19:12] */
+				((inst >> 9) & 0x800) |		/* imm[11]    */
+				((inst >> 20) & 0x7fe);		/* imm[10:1]  */
+		default:
+			return 0;
+	}
+}
+
+/***************************************************************/
+/* Execute an instruction on its operands.                     */
+/* Returns the value for rd (or the effective address for      */
+/* loads/stores) and sets *next_pc to the following PC.        */
+/***************************************************************/
+uint32_t isa_execute(const inst_desc_t *d, uint32_t pc, uint32_t a, uint32_t b, int32_t imm, uint32_t *next_pc)
+{
+	*next_pc = pc + 4;
+	switch (d->iclass) {
+		case CLASS_ALU:
+			return d->op(a, d->format == FMT_R ? b : (uint32_t)imm);
+		case CLASS_MUL:
+		case CLASS_DIV:
+			return d->op(a, b);
+		case CLASS_LOAD:
+		case CLASS_STORE:
+			return d->op(a, imm);
+		case CLASS_BRANCH:
+			if (d->op(a, b)) *next_pc = pc + imm;
+			return 0;
+		case CLASS_JAL:
+			*next_pc = pc + imm;
+			return pc + 4;
+		case CLASS_JALR:
+			*next_pc = (a + imm) & ~1u;
+			return pc + 4;
+		case CLASS_LUI:
+			return imm;
+		case CLASS_AUIPC:
+			return pc + imm;
+		default:
+			return 0;
+	}
+}
+
+/***************************************************************/
+/* Size and extend the word read by a load                     */
+/***************************************************************/
+uint32_t isa_load_extend(const inst_desc_t *d, uint32_t word)
+{
+	switch (d->mem_bytes) {
+		case 1:
+			return d->mem_signed ? (uint32_t)(int8_t)word : (word & 0xff);
+		case 2:
+			return d->mem_signed ? (uint32_t)(int16_t)word : (word & 0xffff);
+		default:
+			return word;
+	}
+}
+
+/***************************************************************/
+/* Merge the value of a store into the word already in memory  */
+/***************************************************************/
+uint32_t isa_store_merge(const inst_desc_t *d, uint32_t word, uint32_t value)
+{
+	switch (d->mem_bytes) {
+		case 1:
+			return (word & ~0xffu) | (value & 0xff);
+		case 2:
+			return (word & ~0xffffu) | (value & 0xffff);
+		default:
+			return value;
+	}
+}
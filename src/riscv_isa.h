@@ -0,0 +1,168 @@
+#ifndef RISCV_ISA_H
+#define RISCV_ISA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/***************************************************************/
+/* Instruction encoding formats (decide how the immediate is laid out) */
+/***************************************************************/
+typedef enum {
+	FMT_NONE,
+	FMT_R,
+	FMT_I,
+	FMT_SHAMT,	/* I-type whose imm[11:5] is a funct7 and imm[4:0] a shift amount */
+	FMT_S,
+	FMT_B,
+	FMT_U,
+	FMT_J
+} inst_format_t;
+
+/***************************************************************/
+/* Execution classes (decide what the pipeline does with the result) */
+/***************************************************************/
+typedef enum {
+	CLASS_INVALID,
+	CLASS_ALU,	/* rd = op(rs1, rs2 or imm) */
+	CLASS_LOAD,	/* rd = mem[rs1 + imm] */
+	CLASS_STORE,	/* mem[rs1 + imm] = rs2 */
+	CLASS_BRANCH,	/* if op(rs1, rs2) pc = pc + imm */
+	CLASS_JAL,	/* rd = pc + 4, pc = pc + imm */
+	CLASS_JALR,	/* rd = pc + 4, pc = (rs1 + imm) & ~1 */
+	CLASS_LUI,	/* rd = imm */
+	CLASS_AUIPC,	/* rd = pc + imm */
+	CLASS_MUL,	/* rd = op(rs1, rs2) on the multiplier */
+	CLASS_DIV	/* rd = op(rs1, rs2) on the divider */
+} inst_class_t;
+
+#define MASK_OPC	0x0000007f
+#define MASK_OPC_F3	0x0000707f
+#define MASK_OPC_F3_F7	0xfe00707f
+
+typedef uint32_t (*alu_op_t)(uint32_t a, uint32_t b);
+
+/***************************************************************/
+/* ISA description table.                                      */
+/* X(id, mnemonic, mask, match, format, class, op, mem bytes, signed) */
+/* An instruction word w is <id> when (w & mask) == match.     */
+/***************************************************************/
+#define RISCV_ISA(X) \
+	X(INVALID,	"invalid",	0,		0,		FMT_NONE,	CLASS_INVALID,	NULL,	0, false) \
+	/* RV32I upper immediates and jumps */ \
+	X(LUI,		"lui",		MASK_OPC,	0x00000037,	FMT_U,		CLASS_LUI,	NULL,	0, false) \
+	X(AUIPC,	"auipc",	MASK_OPC,	0x00000017,	FMT_U,		CLASS_AUIPC,	NULL,	0, false) \
+	X(JAL,		"jal",		MASK_OPC,	0x0000006f,	FMT_J,		CLASS_JAL,	NULL,	0, false) \
+	X(JALR,		"jalr",		MASK_OPC_F3,	0x00000067,	FMT_I,		CLASS_JALR,	NULL,	0, false) \
+	/* RV32I branches */ \
+	X(BEQ,		"beq",		MASK_OPC_F3,	0x00000063,	FMT_B,		CLASS_BRANCH,	EQ,	0, false) \
+	X(BNE,		"bne",		MASK_OPC_F3,	0x00001063,	FMT_B,		CLASS_BRANCH,	NE,	0, false) \
+	X(BLT,		"blt",		MASK_OPC_F3,	0x00004063,	FMT_B,		CLASS_BRANCH,	SLT,	0, false) \
+	X(BGE,		"bge",		MASK_OPC_F3,	0x00005063,	FMT_B,		CLASS_BRANCH,	GE,	0, false) \
+	X(BLTU,		"bltu",		MASK_OPC_F3,	0x00006063,	FMT_B,		CLASS_BRANCH,	SLTU,	0, false) \
+	X(BGEU,		"bgeu",		MASK_OPC_F3,	0x00007063,	FMT_B,		CLASS_BRANCH,	GEU,	0, false) \
+	/* RV32I loads and stores */ \
+	X(LB,		"lb",		MASK_OPC_F3,	0x00000003,	FMT_I,		CLASS_LOAD,	ADD,	1, true) \
+	X(LH,		"lh",		MASK_OPC_F3,	0x00001003,	FMT_I,		CLASS_LOAD,	ADD,	2, true) \
+	X(LW,		"lw",		MASK_OPC_F3,	0x00002003,	FMT_I,		CLASS_LOAD,	ADD,	4, true) \
+	X(LBU,		"lbu",		MASK_OPC_F3,	0x00004003,	FMT_I,		CLASS_LOAD,	ADD,	1, false) \
+	X(LHU,		"lhu",		MASK_OPC_F3,	0x00005003,	FMT_I,		CLASS_LOAD,	ADD,	2, false) \
+	X(SB,		"sb",		MASK_OPC_F3,	0x00000023,	FMT_S,		CLASS_STORE,	ADD,	1, false) \
+	X(SH,		"sh",		MASK_OPC_F3,	0x00001023,	FMT_S,		CLASS_STORE,	ADD,	2, false) \
+	X(SW,		"sw",		MASK_OPC_F3,	0x00002023,	FMT_S,		CLASS_STORE,	ADD,	4, false) \
+	/* RV32I register-immediate */ \
+	X(ADDI,		"addi",		MASK_OPC_F3,	0x00000013,	FMT_I,		CLASS_ALU,	ADD,	0, false) \
+	X(SLTI,		"slti",		MASK_OPC_F3,	0x00002013,	FMT_I,		CLASS_ALU,	SLT,	0, false) \
+	X(SLTIU,	"sltiu",	MASK_OPC_F3,	0x00003013,	FMT_I,		CLASS_ALU,	SLTU,	0, false) \
+	X(XORI,		"xori",		MASK_OPC_F3,	0x00004013,	FMT_I,		CLASS_ALU,	XOR,	0, false) \
+	X(ORI,		"ori",		MASK_OPC_F3,	0x00006013,	FMT_I,		CLASS_ALU,	OR,	0, false) \
+	X(ANDI,		"andi",		MASK_OPC_F3,	0x00007013,	FMT_I,		CLASS_ALU,	AND,	0, false) \
+	X(SLLI,		"slli",		MASK_OPC_F3_F7,	0x00001013,	FMT_SHAMT,	CLASS_ALU,	SLL,	0, false) \
+	X(SRLI,		"srli",		MASK_OPC_F3_F7,	0x00005013,	FMT_SHAMT,	CLASS_ALU,	SRL,	0, false) \
+	X(SRAI,		"srai",		MASK_OPC_F3_F7,	0x40005013,	FMT_SHAMT,	CLASS_ALU,	SRA,	0, false) \
+	/* RV32I register-register */ \
+	X(ADD,		"add",		MASK_OPC_F3_F7,	0x00000033,	FMT_R,		CLASS_ALU,	ADD,	0, false) \
+	X(SUB,		"sub",		MASK_OPC_F3_F7,	0x40000033,	FMT_R,		CLASS_ALU,	SUB,	0, false) \
+	X(SLL,		"sll",		MASK_OPC_F3_F7,	0x00001033,	FMT_R,		CLASS_ALU,	SLL,	0, false) \
+	X(SLT,		"slt",		MASK_OPC_F3_F7,	0x00002033,	FMT_R,		CLASS_ALU,	SLT,	0, false) \
+	X(SLTU,		"sltu",		MASK_OPC_F3_F7,	0x00003033,	FMT_R,		CLASS_ALU,	SLTU,	0, false) \
+	X(XOR,		"xor",		MASK_OPC_F3_F7,	0x00004033,	FMT_R,		CLASS_ALU,	XOR,	0, false) \
+	X(SRL,		"srl",		MASK_OPC_F3_F7,	0x00005033,	FMT_R,		CLASS_ALU,	SRL,	0, false) \
+	X(SRA,		"sra",		MASK_OPC_F3_F7,	0x40005033,	FMT_R,		CLASS_ALU,	SRA,	0, false) \
+	X(OR,		"or",		MASK_OPC_F3_F7,	0x00006033,	FMT_R,		CLASS_ALU,	OR,	0, false) \
+	X(AND,		"and",		MASK_OPC_F3_F7,	0x00007033,	FMT_R,		CLASS_ALU,	AND,	0, false) \
+	/* RV32M multiply and divide */ \
+	X(MUL,		"mul",		MASK_OPC_F3_F7,	0x02000033,	FMT_R,		CLASS_MUL,	MUL,	0, false) \
+	X(MULH,		"mulh",		MASK_OPC_F3_F7,	0x02001033,	FMT_R,		CLASS_MUL,	MULH,	0, false) \
+	X(MULHSU,	"mulhsu",	MASK_OPC_F3_F7,	0x02002033,	FMT_R,		CLASS_MUL,	MULHSU,	0, false) \
+	X(MULHU,	"mulhu",	MASK_OPC_F3_F7,	0x02003033,	FMT_R,		CLASS_MUL,	MULHU,	0, false) \
+	X(DIV,		"div",		MASK_OPC_F3_F7,	0x02004033,	FMT_R,		CLASS_DIV,	DIV,	0, false) \
+	X(DIVU,		"divu",		MASK_OPC_F3_F7,	0x02005033,	FMT_R,		CLASS_DIV,	DIVU,	0, false) \
+	X(REM,		"rem",		MASK_OPC_F3_F7,	0x02006033,	FMT_R,		CLASS_DIV,	REM,	0, false) \
+	X(REMU,		"remu",		MASK_OPC_F3_F7,	0x02007033,	FMT_R,		CLASS_DIV,	REMU,	0, false)
+
+#define INST_ENUM(id, ...) INST_##id,
+typedef enum {
+	RISCV_ISA(INST_ENUM)
+	NUM_INSTS
+} inst_id_t;
+#undef INST_ENUM
+
+typedef struct {
+	inst_id_t id;
+	const char *name;
+	uint32_t mask;
+	uint32_t match;
+	inst_format_t format;
+	inst_class_t iclass;
+	alu_op_t op;
+	uint8_t mem_bytes;
+	bool mem_signed;
+} inst_desc_t;
+
+extern const inst_desc_t ISA_TABLE[NUM_INSTS];
+
+/***************************************************************/
+/* Dense decode table, indexed by opcode[6:2], funct3, inst[30] and inst[25]. */
+/* Filled once from ISA_TABLE by isa_init().                   */
+/***************************************************************/
+#define DECODE_KEY_BITS 10
+extern uint8_t DECODE_TABLE[1 << DECODE_KEY_BITS];
+
+static inline uint32_t decode_key(uint32_t inst)
+{
+	return ((inst >> 2) & 0x01f) |	/* opcode[6:2] -> key[4:0] */
+		((inst >> 7) & 0x0e0) |	/* funct3      -> key[7:5] */
+		((inst >> 22) & 0x100) |	/* inst[30]    -> key[8]   */
+		((inst >> 16) & 0x200);	/* inst[25]    -> key[9]   */
+}
+
+/* one table lookup plus a mask check against the candidate entry */
+static inline const inst_desc_t* isa_decode(uint32_t inst)
+{
+	const inst_desc_t *d = &ISA_TABLE[DECODE_TABLE[decode_key(inst)]];
+	return ((inst & d->mask) == d->match) ? d : &ISA_TABLE[INST_INVALID];
+}
+
+static inline bool isa_reads_rs1(const inst_desc_t *d)
+{
+	return d->format == FMT_R || d->format == FMT_I || d->format == FMT_SHAMT ||
+		d->format == FMT_S || d->format == FMT_B;
+}
+
+static inline bool isa_reads_rs2(const inst_desc_t *d)
+{
+	return d->format == FMT_R || d->format == FMT_S || d->format == FMT_B;
+}
+
+static inline bool isa_writes_rd(const inst_desc_t *d)
+{
+	return d->iclass != CLASS_INVALID && d->iclass != CLASS_STORE && d->iclass != CLASS_BRANCH;
+}
+
+void isa_init();
+int32_t isa_imm(const inst_desc_t *d, uint32_t inst);
+uint32_t isa_execute(const inst_desc_t *d, uint32_t pc, uint32_t a, uint32_t b, int32_t imm, uint32_t *next_pc);
+uint32_t isa_load_extend(const inst_desc_t *d, uint32_t word);
+uint32_t isa_store_merge(const inst_desc_t *d, uint32_t word, uint32_t value);
+
+#endif
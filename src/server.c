@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "mu-riscv.h"
+#include "profile.h"
+#include "reverse.h"
+#include "journal.h"
+#include "server.h"
+
+static int listen_fd;
+static volatile sig_atomic_t stopping;
+
+static uint32_t *words;
+static uint32_t words_size;
+static Mem_Word *written;
+static uint32_t written_size;
+static char *out;
+static uint32_t out_size;
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	ssize_t n;
+	while (len) {
+		n = read(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t n;
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return FALSE;
+		p += n;
+		len -= n;
+	}
+	return TRUE;
+}
+
+/***************************************************************/
+/* Load the program at MEM_TEXT_BEGIN and run it on a clean    */
+/* pipeline. Every write, the program text included, goes into */
+/* the journal; the writes from <mark> on are the program's.   */
+/***************************************************************/
+static void run_job(const Server_Request *req, const uint32_t *regs, Server_Response *res, uint32_t *mark)
+{
+	uint32_t i, budget = req->max_cycles ? req->max_cycles : SERVER_MAX_CYCLES;
+
+	JOURNAL_ON = TRUE;
+	for (i = 0; i < req->num_words; i++) mem_write_32(MEM_TEXT_BEGIN + 4 * i, words[i]);
+	*mark = journal_length();
+	PROGRAM_SIZE = req->num_words;
+	profile_init();
+
+	memset(&CURRENT_STATE, 0, sizeof(CURRENT_STATE));
+	if (regs) memcpy(CURRENT_STATE.REGS, regs, sizeof(CURRENT_STATE.REGS));
+	CURRENT_STATE.REGS[0] = 0;
+	reset_pipeline();
+
+	while (RUN_FLAG && CYCLE_COUNT < budget) cycle();
+
+	res->magic = SERVER_MAGIC;
+	res->status = RUN_FLAG ? SERVER_BUDGET : SERVER_DONE;
+	res->cycles = CYCLE_COUNT;
+	res->instructions = INSTRUCTION_COUNT;
+	res->pc = CURRENT_STATE.PC;
+	res->stall_cycles = 0;
+	for (i = 0; i < NUM_STALL_CAUSES; i++) res->stall_cycles += STALL_CYCLES[i];
+	res->branch_flushes = BRANCH_FLUSHES;
+}
+
+static void reserve_out(uint32_t len)
+{
+	if (len > out_size) {
+		out_size = len;
+		out = realloc(out, out_size);
+	}
+}
+
+/* the answer after the length word, returns its size */
+static uint32_t format_binary(const Server_Response *res)
+{
+	uint32_t len = sizeof(*res) + sizeof(CURRENT_STATE.REGS) + res->num_written * sizeof(Mem_Word);
+
+	reserve_out(sizeof(uint32_t) + len);
+	memcpy(out + sizeof(uint32_t), res, sizeof(*res));
+	memcpy(out + sizeof(uint32_t) + sizeof(*res), CURRENT_STATE.REGS, sizeof(CURRENT_STATE.REGS));
+	memcpy(out + sizeof(uint32_t) + sizeof(*res) + sizeof(CURRENT_STATE.REGS), written, res->num_written * sizeof(Mem_Word));
+	return len;
+}
+
+static uint32_t format_json(const Server_Response *res)
+{
+	static const char *STATUS_NAMES[] = { "done", "budget", "bad request" };
+	uint32_t i, len;
+	char *p;
+
+	reserve_out(sizeof(uint32_t) + 512 + MIPS_REGS * 12 + res->num_written * 48);
+	p = out + sizeof(uint32_t);
+	p += sprintf(p, "{\"status\":\"%s\",\"cycles\":%u,\"instructions\":%u,\"pc\":%u,"
+		"\"stall_cycles\":%u,\"branch_flushes\":%u,\"regs\":[",
+		STATUS_NAMES[res->status], res->cycles, res->instructions, res->pc,
+		res->stall_cycles, res->branch_flushes);
+	for (i = 0; i < MIPS_REGS; i++) p += sprintf(p, i ? ",%u" : "%u", CURRENT_STATE.REGS[i]);
+	p += sprintf(p, "],\"memory\":[");
+	for (i = 0; i < res->num_written; i++) {
+		p += sprintf(p, "%s{\"address\":%u,\"value\":%u}", i ? "," : "", written[i].address, written[i].value);
+	}
+	p += sprintf(p, "]}\n");
+	len = p - (out + sizeof(uint32_t));
+	return len;
+}
+
+/***************************************************************/
+/* Serve the jobs of one connection until it is closed or      */
+/* sends a bad request                                         */
+/***************************************************************/
+static void serve_connection(int fd)
+{
+	Server_Request req;
+	Server_Response res;
+	uint32_t regs[MIPS_REGS];
+	uint32_t mark, len;
+
+	while (read_full(fd, &req, sizeof(req))) {
+		if (req.magic != SERVER_MAGIC || req.num_words > SERVER_MAX_WORDS) {
+			memset(&res, 0, sizeof(res));
+			res.magic = SERVER_MAGIC;
+			res.status = SERVER_BAD_REQUEST;
+			len = sizeof(res);
+			reserve_out(sizeof(uint32_t) + len);
+			memcpy(out + sizeof(uint32_t), &res, len);
+			memcpy(out, &len, sizeof(len));
+			write_full(fd, out, sizeof(uint32_t) + len);
+			return;
+		}
+		if ((req.flags & SERVER_REGS) && !read_full(fd, regs, sizeof(regs))) return;
+		if (req.num_words > words_size) {
+			words_size = req.num_words;
+			words = realloc(words, words_size * sizeof(uint32_t));
+		}
+		if (!read_full(fd, words, req.num_words * sizeof(uint32_t))) return;
+
+		run_job(&req, (req.flags & SERVER_REGS) ? regs : NULL, &res, &mark);
+		if (journal_length() - mark > written_size) {
+			written_size = journal_length() - mark;
+			written = realloc(written, written_size * sizeof(Mem_Word));
+		}
+		res.num_written = journal_written(mark, written);
+		len = (req.flags & SERVER_JSON) ? format_json(&res) : format_binary(&res);
+		journal_rollback();
+
+		memcpy(out, &len, sizeof(len));
+		if (!write_full(fd, out, sizeof(uint32_t) + len)) return;
+	}
+}
+
+static void worker()
+{
+	int fd;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_IGN);
+	while (1) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			perror("accept");
+			exit(1);
+		}
+		serve_connection(fd);
+		close(fd);
+	}
+}
+
+static pid_t spawn_worker()
+{
+	pid_t pid = fork();
+	if (pid == 0) worker();
+	if (pid < 0) perror("fork");
+	return pid;
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	stopping = TRUE;
+}
+
+/***************************************************************/
+/* Listen on <path> and keep <workers> worker processes        */
+/* accepting jobs until SIGINT or SIGTERM. The simulator is    */
+/* initialized once here, the workers inherit it.              */
+/***************************************************************/
+void server_run(const char *path, int workers)
+{
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	pid_t *pids, pid;
+	int i;
+
+	if (workers < 1) workers = SERVER_WORKERS;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		printf("Error: socket path %s is too long\n", path);
+		exit(1);
+	}
+
+	initialize();
+	REVERSE_ON = FALSE;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+		perror(path);
+		exit(1);
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	pids = calloc(workers, sizeof(pid_t));
+	fflush(stdout);
+	for (i = 0; i < workers; i++) pids[i] = spawn_worker();
+	printf("Serving on %s with %d workers\n", path, workers);
+	fflush(stdout);
+
+	/* replace the workers that die */
+	while (!stopping) {
+		pid = wait(NULL);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		for (i = 0; i < workers; i++) {
+			if (pids[i] == pid) pids[i] = spawn_worker();
+		}
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (pids[i] > 0) kill(pids[i], SIGTERM);
+	}
+	while (wait(NULL) > 0);
+	close(listen_fd);
+	unlink(path);
+	free(pids);
+	exit(0);
+}
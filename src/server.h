@@ -0,0 +1,51 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+/***************************************************************/
+/* Simulation daemon: mu-mips --serve <socket> [workers]       */
+/* Pre-forked workers share the initialized simulator and      */
+/* accept jobs on a Unix domain socket. A connection carries   */
+/* any number of jobs, each a Server_Request, the initial      */
+/* registers if SERVER_REGS is set, then <num_words> program   */
+/* words. The answer is a 32-bit length followed by a          */
+/* Server_Response, the registers and the written words, or    */
+/* by a JSON object if SERVER_JSON is set. Memory is rolled    */
+/* back through the journal after every job.                   */
+/***************************************************************/
+#define SERVER_MAGIC 0x4d555253		/* "MURS" */
+#define SERVER_WORKERS 4
+#define SERVER_MAX_WORDS (1 << 20)	/* program words per job */
+#define SERVER_MAX_CYCLES 100000000	/* cycle budget of jobs that ask for 0 */
+
+#define SERVER_REGS 1	/* initial registers follow the request */
+#define SERVER_JSON 2	/* answer in JSON */
+
+typedef enum {
+	SERVER_DONE,		/* the program left its text */
+	SERVER_BUDGET,		/* the cycle budget ran out first */
+	SERVER_BAD_REQUEST	/* bad magic or size, the connection is closed */
+} server_status_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t max_cycles;
+	uint32_t num_words;
+} Server_Request;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t status;
+	uint32_t cycles;
+	uint32_t instructions;
+	uint32_t pc;
+	uint32_t stall_cycles;
+	uint32_t branch_flushes;
+	uint32_t num_written;	/* (address, value) pairs after the registers */
+} Server_Response;
+
+void server_run(const char *path, int workers);
+
+#endif
@@ -0,0 +1,401 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <limits.h>
+
+#include "mu-riscv.h"
+#include "riscv_utils.h"
+#include "memchar.h"
+#include "simpoint.h"
+
+/***************************************************************/
+/* SimPoint-style sampled simulation.                          */
+/*                                                             */
+/* 1. profile: run the program functionally and record one     */
+/*    basic-block vector (BBV) per <interval> instructions,    */
+/*    randomly projected to BBV_DIMS dimensions.               */
+/* 2. cluster: k-means for k = 1..max_k, the smallest k whose  */
+/*    BIC reaches 90% of the best score is kept.               */
+/* 3. simulate: fast-forward to each chosen interval, warm the */
+/*    pipeline for <warmup> instructions and measure its CPI   */
+/*    in the detailed pipeline.                                */
+/***************************************************************/
+
+typedef struct {
+	uint32_t start;		/* index of its first instruction */
+	uint32_t length;	/* instructions in the interval */
+	double v[BBV_DIMS];	/* projected BBV, normalized by length */
+	int cluster;
+} BBV_Interval;
+
+typedef struct {
+	BBV_Interval *iv;
+	uint32_t count, size;
+	uint32_t num_bbs;
+} BBV_Profile;
+
+typedef struct {
+	int k;
+	double centers[MAX_SIMPOINTS][BBV_DIMS];
+	uint32_t members[MAX_SIMPOINTS];
+	double bic;
+} Clustering;
+
+static uint32_t rng_state;
+
+static uint32_t rng_next()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+/* fixed random projection coefficient in [-1, 1] for basic block <bb>, dimension <d> */
+static double projection(uint32_t bb, int d)
+{
+	uint32_t h = (bb + 1) * 0x9e3779b1u ^ (d + 1) * 0x85ebca6bu;
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	return (h / 4294967295.0) * 2.0 - 1.0;
+}
+
+static double distance2(const double *a, const double *b)
+{
+	double sum = 0;
+	int d;
+	for (d = 0; d < BBV_DIMS; d++) sum += (a[d] - b[d]) * (a[d] - b[d]);
+	return sum;
+}
+
+/***************************************************************/
+/* Profile pass: functional execution, one BBV per interval.   */
+/* Basic blocks are numbered by their leader PC in a dense     */
+/* array parallel to the text segment. The raw vectors are     */
+/* also written in SimPoint's .bb format.                      */
+/***************************************************************/
+static void profile_bbv(BBV_Profile *prof, uint32_t interval, FILE *bb_out)
+{
+	int32_t *bb_of_pc = malloc(PROGRAM_SIZE * sizeof(int32_t));
+	uint32_t *bb_count = calloc(PROGRAM_SIZE, sizeof(uint32_t));
+	uint32_t *touched = malloc(PROGRAM_SIZE * sizeof(uint32_t));
+	uint32_t num_touched = 0, in_interval = 0, i;
+	int32_t bb = -1;
+	bool leader = true;
+
+	memset(bb_of_pc, -1, PROGRAM_SIZE * sizeof(int32_t));
+	prof->count = prof->num_bbs = 0;
+
+	while (RUN_FLAG) {
+		uint32_t pc = CURRENT_STATE.PC;
+		if (in_program(pc) && leader) {
+			uint32_t index = (pc - MEM_TEXT_BEGIN) >> 2;
+			if (bb_of_pc[index] < 0) bb_of_pc[index] = prof->num_bbs++;
+			bb = bb_of_pc[index];
+		}
+
+		const inst_desc_t *d = step_functional();
+		if (!d) break;
+		leader = (d->iclass == CLASS_BRANCH || d->iclass == CLASS_JAL || d->iclass == CLASS_JALR);
+
+		if (bb_count[bb]++ == 0) touched[num_touched++] = bb;
+		in_interval++;
+
+		if (in_interval == interval || !in_program(CURRENT_STATE.PC)) {
+			BBV_Interval *iv;
+			if (prof->count == prof->size) {
+				prof->size = prof->size ? prof->size * 2 : 1024;
+				prof->iv = realloc(prof->iv, prof->size * sizeof(BBV_Interval));
+			}
+			iv = &prof->iv[prof->count++];
+			memset(iv, 0, sizeof(*iv));
+			iv->start = INSTRUCTION_COUNT - in_interval;
+			iv->length = in_interval;
+
+			if (bb_out) fprintf(bb_out, "T");
+			for (i = 0; i < num_touched; i++) {
+				uint32_t b = touched[i];
+				int dim;
+				for (dim = 0; dim < BBV_DIMS; dim++) {
+					iv->v[dim] += bb_count[b] * projection(b, dim);
+				}
+				if (bb_out) fprintf(bb_out, ":%u:%u ", b + 1, bb_count[b]);
+				bb_count[b] = 0;
+			}
+			if (bb_out) fprintf(bb_out, "\n");
+			for (i = 0; i < BBV_DIMS; i++) iv->v[i] /= in_interval;
+			num_touched = 0;
+			in_interval = 0;
+		}
+	}
+
+	free(bb_of_pc);
+	free(bb_count);
+	free(touched);
+}
+
+/***************************************************************/
+/* k-means with k-means++ seeding, scored with the BIC used by */
+/* SimPoint (spherical Gaussians with a shared variance)       */
+/***************************************************************/
+static void kmeans(BBV_Profile *prof, int k, Clustering *c, int *assign)
+{
+	uint32_t n = prof->count, i, iter;
+	double *dist = malloc(n * sizeof(double));
+	int j, dim;
+
+	c->k = k;
+	rng_state = 0x2545f491;
+
+	/* k-means++ seeding */
+	memcpy(c->centers[0], prof->iv[rng_next() % n].v, sizeof(c->centers[0]));
+	for (j = 1; j < k; j++) {
+		double total = 0, pick;
+		for (i = 0; i < n; i++) {
+			int m;
+			dist[i] = INFINITY;
+			for (m = 0; m < j; m++) {
+				double d2 = distance2(prof->iv[i].v, c->centers[m]);
+				if (d2 < dist[i]) dist[i] = d2;
+			}
+			total += dist[i];
+		}
+		pick = (rng_next() / 4294967296.0) * total;
+		for (i = 0; i + 1 < n && pick >= dist[i]; i++) pick -= dist[i];
+		memcpy(c->centers[j], prof->iv[i].v, sizeof(c->centers[j]));
+	}
+
+	/* Lloyd iterations */
+	for (iter = 0; iter < 100; iter++) {
+		double sums[MAX_SIMPOINTS][BBV_DIMS] = {{0}};
+		bool changed = false;
+
+		memset(c->members, 0, sizeof(c->members));
+		for (i = 0; i < n; i++) {
+			int best = 0;
+			double best_d2 = INFINITY;
+			for (j = 0; j < k; j++) {
+				double d2 = distance2(prof->iv[i].v, c->centers[j]);
+				if (d2 < best_d2) {
+					best_d2 = d2;
+					best = j;
+				}
+			}
+			if (iter == 0 || assign[i] != best) changed = true;
+			assign[i] = best;
+			c->members[best]++;
+			for (dim = 0; dim < BBV_DIMS; dim++) sums[best][dim] += prof->iv[i].v[dim];
+		}
+		for (j = 0; j < k; j++) {
+			if (!c->members[j]) continue;
+			for (dim = 0; dim < BBV_DIMS; dim++) c->centers[j][dim] = sums[j][dim] / c->members[j];
+		}
+		if (!changed) break;
+	}
+
+	/* BIC = log-likelihood - (free parameters / 2) * log(R) */
+	double sse = 0, loglik = 0, variance;
+	for (i = 0; i < n; i++) sse += distance2(prof->iv[i].v, c->centers[assign[i]]);
+	variance = (n > (uint32_t)k) ? sse / (n - k) : 0;
+	if (variance < 1e-12) variance = 1e-12;
+	for (j = 0; j < k; j++) {
+		double rn = c->members[j];
+		if (rn == 0) continue;
+		loglik += rn * log(rn) - rn * log((double)n) - rn / 2.0 * log(2.0 * M_PI) -
+			rn * BBV_DIMS / 2.0 * log(variance) - (rn - k) / 2.0;
+	}
+	c->bic = loglik - ((k - 1) + BBV_DIMS * k + 1) / 2.0 * log((double)n);
+
+	free(dist);
+}
+
+/***************************************************************/
+/* Run the detailed pipeline until <target> instructions have  */
+/* retired, returns the cycles it took                         */
+/***************************************************************/
+static uint32_t run_detailed(uint32_t target)
+{
+	uint32_t start = CYCLE_COUNT;
+	while (RUN_FLAG && INSTRUCTION_COUNT < target) {
+		cycle();
+	}
+	return CYCLE_COUNT - start;
+}
+
+typedef struct {
+	uint32_t interval;	/* index into the profile */
+	int cluster;
+	double cpi;
+} Sample;
+
+static int sample_cmp(const void *a, const void *b)
+{
+	const Sample *x = a, *y = b;
+	return (x->interval > y->interval) - (x->interval < y->interval);
+}
+
+/* open <prefix><suffix> for writing, NULL without a prefix or on error */
+static FILE* open_output(const char *prefix, const char *suffix)
+{
+	char path[PATH_MAX];
+	FILE *fp;
+
+	if (prefix == NULL) return NULL;
+	if (snprintf(path, sizeof(path), "%s%s", prefix, suffix) >= (int)sizeof(path)) {
+		printf("Error: output path %s%s is too long\n", prefix, suffix);
+		return NULL;
+	}
+	fp = fopen(path, "w");
+	if (fp == NULL) printf("Error: Can't write %s\n", path);
+	else printf("Writing %s\n", path);
+	return fp;
+}
+
+/***************************************************************/
+/* Profile, cluster and simulate the chosen intervals. With a  */
+/* <prefix>, the BBVs, the simulation points and their weights */
+/* go to <prefix>.bb, .simpoints and .weights.                 */
+/***************************************************************/
+void simpoint_run(uint32_t interval, uint32_t warmup, uint32_t max_k, const char *prefix)
+{
+	BBV_Profile prof = { 0 };
+	Clustering *runs, *best;
+	int *assign, *best_assign, k, chosen_k = 1, j;
+	uint32_t i, num_samples = 0, detailed_insts = 0, total_insts;
+	Sample samples[2 * MAX_SIMPOINTS];
+	FILE *bb_out, *sp_out, *w_out;
+	int memchar_on = MEMCHAR_ON;
+
+	if (interval == 0) {
+		printf("Interval length must be positive.\n\n");
+		return;
+	}
+	if (max_k < 1) max_k = 1;
+	if (max_k > MAX_SIMPOINTS) max_k = MAX_SIMPOINTS;
+
+	/* 1. profile, the warm-up and detailed runs are not characterized */
+	MEMCHAR_ON = FALSE;
+	reset();
+	bb_out = open_output(prefix, ".bb");
+	profile_bbv(&prof, interval, bb_out);
+	if (bb_out) fclose(bb_out);
+	total_insts = INSTRUCTION_COUNT;
+	if (prof.count == 0) {
+		printf("Nothing to sample, the program retired no instructions.\n\n");
+		MEMCHAR_ON = memchar_on;
+		return;
+	}
+	printf("Profiled %u instructions: %u intervals of %u, %u basic blocks\n",
+		total_insts, prof.count, interval, prof.num_bbs);
+
+	/* 2. cluster, keep the smallest k scoring within 90% of the BIC range */
+	if (max_k > prof.count) max_k = prof.count;
+	runs = malloc(max_k * sizeof(Clustering));
+	assign = malloc(max_k * prof.count * sizeof(int));
+	for (k = 1; k <= (int)max_k; k++) {
+		kmeans(&prof, k, &runs[k - 1], &assign[(k - 1) * prof.count]);
+	}
+	double bic_min = runs[0].bic, bic_max = runs[0].bic;
+	for (k = 1; k < (int)max_k; k++) {
+		if (runs[k].bic < bic_min) bic_min = runs[k].bic;
+		if (runs[k].bic > bic_max) bic_max = runs[k].bic;
+	}
+	for (k = 1; k <= (int)max_k; k++) {
+		if (runs[k - 1].bic >= bic_min + 0.9 * (bic_max - bic_min)) {
+			chosen_k = k;
+			break;
+		}
+	}
+	best = &runs[chosen_k - 1];
+	best_assign = &assign[(chosen_k - 1) * prof.count];
+
+	/* per cluster: the interval closest to the centroid, and the runner-up to estimate the spread */
+	for (j = 0; j < chosen_k; j++) {
+		int64_t first = -1, second = -1;
+		double d_first = INFINITY, d_second = INFINITY;
+		for (i = 0; i < prof.count; i++) {
+			if (best_assign[i] != j) continue;
+			double d2 = distance2(prof.iv[i].v, best->centers[j]);
+			if (d2 < d_first) {
+				second = first; d_second = d_first;
+				first = i; d_first = d2;
+			} else if (d2 < d_second) {
+				second = i; d_second = d2;
+			}
+		}
+		if (first >= 0) samples[num_samples++] = (Sample){ first, j, 0 };
+		if (second >= 0) samples[num_samples++] = (Sample){ second, j, 0 };
+	}
+	qsort(samples, num_samples, sizeof(Sample), sample_cmp);
+
+	sp_out = open_output(prefix, ".simpoints");
+	w_out = open_output(prefix, ".weights");
+
+	/* 3. simulate the chosen intervals in program order in one pass */
+	reset();
+	for (i = 0; i < num_samples; i++) {
+		BBV_Interval *iv = &prof.iv[samples[i].interval];
+		uint32_t begin = iv->start > warmup ? iv->start - warmup : 0;
+		uint32_t measured_from, cycles;
+
+		if (INSTRUCTION_COUNT < begin) fast_forward(begin);
+		detailed_insts -= INSTRUCTION_COUNT;
+		run_detailed(iv->start);
+		measured_from = INSTRUCTION_COUNT;
+		cycles = run_detailed(iv->start + iv->length);
+		samples[i].cpi = (INSTRUCTION_COUNT > measured_from) ? (double)cycles / (INSTRUCTION_COUNT - measured_from) : 0;
+		drain_pipeline();
+		detailed_insts += INSTRUCTION_COUNT;
+	}
+
+	/* weighted CPI from the mean of each cluster's samples, error from their spread */
+	double cpi = 0, variance = 0;
+	printf("-------------------------------------\n");
+	printf("[Cluster] [Weight] [Interval] [CPI]\n");
+	printf("-------------------------------------\n");
+	for (j = 0; j < chosen_k; j++) {
+		uint32_t cluster_insts = 0;
+		double sum = 0, lo = INFINITY, hi = -INFINITY, weight;
+		int n = 0;
+		for (i = 0; i < prof.count; i++) {
+			if (best_assign[i] == j) cluster_insts += prof.iv[i].length;
+		}
+		weight = (double)cluster_insts / total_insts;
+		for (i = 0; i < num_samples; i++) {
+			if (samples[i].cluster != j) continue;
+			if (n == 0) {
+				printf("%-9d %-8.4f %-10u %.3f\n", j, weight, samples[i].interval, samples[i].cpi);
+				if (sp_out) fprintf(sp_out, "%u %d\n", samples[i].interval, j);
+				if (w_out) fprintf(w_out, "%f %d\n", weight, j);
+			}
+			sum += samples[i].cpi;
+			if (samples[i].cpi < lo) lo = samples[i].cpi;
+			if (samples[i].cpi > hi) hi = samples[i].cpi;
+			n++;
+		}
+		if (n == 0) continue;
+		cpi += weight * sum / n;
+		/* two samples: the standard error of their mean is |x1 - x2| / 2 */
+		if (n > 1) variance += weight * weight * (hi - lo) * (hi - lo) / 4.0;
+	}
+	if (sp_out) fclose(sp_out);
+	if (w_out) fclose(w_out);
+
+	printf("-------------------------------------\n");
+	printf("Clusters\t\t: %d (of at most %u)\n", chosen_k, max_k);
+	printf("Weighted CPI\t\t: %.4f\n", cpi);
+	printf("Estimated error\t\t: +/- %.4f (%.2f%%)\n", sqrt(variance), cpi > 0 ? 100.0 * sqrt(variance) / cpi : 0.0);
+	printf("Detailed instructions\t: %u of %u (%.2f%%)\n", detailed_insts, total_insts,
+		total_insts ? 100.0 * detailed_insts / total_insts : 0.0);
+	printf("-------------------------------------\n");
+
+	free(prof.iv);
+	free(runs);
+	free(assign);
+	MEMCHAR_ON = memchar_on;
+	reset();
+}
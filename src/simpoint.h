@@ -0,0 +1,11 @@
+#ifndef SIMPOINT_H
+#define SIMPOINT_H
+
+#include <stdint.h>
+
+#define BBV_DIMS 15		/* basic-block vectors are randomly projected to this many dimensions */
+#define MAX_SIMPOINTS 32	/* upper bound on the number of clusters */
+
+void simpoint_run(uint32_t interval, uint32_t warmup, uint32_t max_k, const char *prefix);
+
+#endif